@@ -12,19 +12,104 @@ Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
 // order_adjacency_matrix
-Eigen::VectorXi order_adjacency_matrix(Eigen::MatrixXi& m);
+Eigen::VectorXi order_adjacency_matrix(const Eigen::Map<Eigen::SparseMatrix<double> > m);
 RcppExport SEXP _npmlangevin_order_adjacency_matrix(SEXP mSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Eigen::MatrixXi& >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::SparseMatrix<double> > >::type m(mSEXP);
     rcpp_result_gen = Rcpp::wrap(order_adjacency_matrix(m));
     return rcpp_result_gen;
 END_RCPP
 }
+// adjacency_edge_list
+Rcpp::List adjacency_edge_list(const Eigen::Map<Eigen::SparseMatrix<double> > m, const Eigen::VectorXi& order, int n_init);
+RcppExport SEXP _npmlangevin_adjacency_edge_list(SEXP mSEXP, SEXP orderSEXP, SEXP n_initSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::SparseMatrix<double> > >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const Eigen::VectorXi& >::type order(orderSEXP);
+    Rcpp::traits::input_parameter< int >::type n_init(n_initSEXP);
+    rcpp_result_gen = Rcpp::wrap(adjacency_edge_list(m, order, n_init));
+    return rcpp_result_gen;
+END_RCPP
+}
+// lattice_graph
+Rcpp::List lattice_graph(int xl, int yl);
+RcppExport SEXP _npmlangevin_lattice_graph(SEXP xlSEXP, SEXP ylSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type xl(xlSEXP);
+    Rcpp::traits::input_parameter< int >::type yl(ylSEXP);
+    rcpp_result_gen = Rcpp::wrap(lattice_graph(xl, yl));
+    return rcpp_result_gen;
+END_RCPP
+}
+// lattice_pred_parents
+Rcpp::List lattice_pred_parents(const Eigen::VectorXd& x, const Eigen::VectorXd& y, const Eigen::MatrixXd& coord, const Eigen::VectorXi& v, int k);
+RcppExport SEXP _npmlangevin_lattice_pred_parents(SEXP xSEXP, SEXP ySEXP, SEXP coordSEXP, SEXP vSEXP, SEXP kSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Eigen::VectorXd& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const Eigen::VectorXd& >::type y(ySEXP);
+    Rcpp::traits::input_parameter< const Eigen::MatrixXd& >::type coord(coordSEXP);
+    Rcpp::traits::input_parameter< const Eigen::VectorXi& >::type v(vSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    rcpp_result_gen = Rcpp::wrap(lattice_pred_parents(x, y, coord, v, k));
+    return rcpp_result_gen;
+END_RCPP
+}
+// inflection_point
+double inflection_point(int cv_code, const Eigen::VectorXd& cv_pars);
+RcppExport SEXP _npmlangevin_inflection_point(SEXP cv_codeSEXP, SEXP cv_parsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type cv_code(cv_codeSEXP);
+    Rcpp::traits::input_parameter< const Eigen::VectorXd& >::type cv_pars(cv_parsSEXP);
+    rcpp_result_gen = Rcpp::wrap(inflection_point(cv_code, cv_pars));
+    return rcpp_result_gen;
+END_RCPP
+}
+// starve_pred_parents
+Rcpp::List starve_pred_parents(const Eigen::MatrixXd& pred, const Eigen::MatrixXd& field, int k);
+RcppExport SEXP _npmlangevin_starve_pred_parents(SEXP predSEXP, SEXP fieldSEXP, SEXP kSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Eigen::MatrixXd& >::type pred(predSEXP);
+    Rcpp::traits::input_parameter< const Eigen::MatrixXd& >::type field(fieldSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    rcpp_result_gen = Rcpp::wrap(starve_pred_parents(pred, field, k));
+    return rcpp_result_gen;
+END_RCPP
+}
+// starve_gg_pred_parents
+Rcpp::List starve_gg_pred_parents(const Eigen::MatrixXd& pred, const Eigen::MatrixXd& field, double shift, int k);
+RcppExport SEXP _npmlangevin_starve_gg_pred_parents(SEXP predSEXP, SEXP fieldSEXP, SEXP shiftSEXP, SEXP kSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Eigen::MatrixXd& >::type pred(predSEXP);
+    Rcpp::traits::input_parameter< const Eigen::MatrixXd& >::type field(fieldSEXP);
+    Rcpp::traits::input_parameter< double >::type shift(shiftSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    rcpp_result_gen = Rcpp::wrap(starve_gg_pred_parents(pred, field, shift, k));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
     {"_npmlangevin_order_adjacency_matrix", (DL_FUNC) &_npmlangevin_order_adjacency_matrix, 1},
+    {"_npmlangevin_adjacency_edge_list", (DL_FUNC) &_npmlangevin_adjacency_edge_list, 3},
+    {"_npmlangevin_lattice_graph", (DL_FUNC) &_npmlangevin_lattice_graph, 2},
+    {"_npmlangevin_lattice_pred_parents", (DL_FUNC) &_npmlangevin_lattice_pred_parents, 5},
+    {"_npmlangevin_inflection_point", (DL_FUNC) &_npmlangevin_inflection_point, 2},
+    {"_npmlangevin_starve_pred_parents", (DL_FUNC) &_npmlangevin_starve_pred_parents, 3},
+    {"_npmlangevin_starve_gg_pred_parents", (DL_FUNC) &_npmlangevin_starve_gg_pred_parents, 4},
     {NULL, NULL, 0}
 };
 
@@ -0,0 +1,60 @@
+// Closed form bivariate normal log-density, avoiding the generic MVNORM_t
+// factorisation for the 2 x 2 ping covariances
+template<class Type>
+class bivariate_normal {
+  private:
+    // Precision matrix entries
+    Type prec00;
+    Type prec01;
+    Type prec11;
+    Type log_const; // -log(2 pi) - 0.5 * log|Sigma|
+  public:
+    bivariate_normal(const matrix<Type>& Sigma) {
+      Type det = Sigma(0, 0) * Sigma(1, 1) - Sigma(0, 1) * Sigma(1, 0);
+      prec00 = Sigma(1, 1) / det;
+      prec01 = -0.5 * (Sigma(0, 1) + Sigma(1, 0)) / det;
+      prec11 = Sigma(0, 0) / det;
+      log_const = -log(2.0 * M_PI) - 0.5 * log(det);
+    };
+    bivariate_normal() = default;
+
+    // Log-density of a zero mean residual
+    Type loglikelihood(Type r0, Type r1) {
+      return log_const - 0.5 * (prec00 * r0 * r0 + 2.0 * prec01 * r0 * r1 + prec11 * r1 * r1);
+    }
+    template<class Vec>
+    Type loglikelihood(const Vec& r) { return loglikelihood(r(0), r(1)); }
+};
+
+// Ping error distributions for each location quality class q, with covariance
+// diag(K_q) Sigma diag(K_q), and for the difference of two pings with quality
+// classes q1 & q2
+template<class Type>
+class ping_covariances {
+  private:
+    int n_class;
+    vector<bivariate_normal<Type> > singles;
+    vector<bivariate_normal<Type> > pairs; // pairs(q1 + n_class * q2)
+  public:
+    ping_covariances(const matrix<Type>& Sigma, const matrix<Type>& K) : n_class(K.rows()) {
+      vector<matrix<Type> > conjugates(n_class);
+      for(int q = 0; q < n_class; q++) {
+        matrix<Type> diagK(2, 2);
+        diagK << K(q, 0), 0.0, 0.0, K(q, 1);
+        conjugates(q) = diagK * Sigma * diagK;
+      }
+
+      singles.resize(n_class);
+      pairs.resize(n_class * n_class);
+      for(int q1 = 0; q1 < n_class; q1++) {
+        singles(q1) = bivariate_normal<Type>(conjugates(q1));
+        for(int q2 = 0; q2 < n_class; q2++) {
+          pairs(q1 + n_class * q2) = bivariate_normal<Type>(conjugates(q1) + conjugates(q2));
+        }
+      }
+    };
+    ping_covariances() = default;
+
+    bivariate_normal<Type>& operator() (int q) { return singles(q); }
+    bivariate_normal<Type>& operator() (int q1, int q2) { return pairs(q1 + n_class * q2); }
+};
@@ -1,11 +1,23 @@
 template<class Type>
 class conditional_normal {
   private:
-    matrix<Type> full_sigma; // Full covariance matrix
+    typedef Eigen::Matrix<Type, Dynamic, 1> column;
+
     int nc; // Number of components conditioned on
     int np; // Number of components in resulting conditional distribution
-    matrix<Type> c_sigma_inv; // Sigma_12 * Sigma_22^-1
-    MVNORM_t<Type> mvn;
+
+    // Lower Cholesky factor of the full covariance matrix reordered as
+    // [conditioned; predicted], i.e. L = [L_cc, 0; L_pc, L_pp]. Then
+    //   Sigma_pc * Sigma_cc^-1 = L_pc * L_cc^-1
+    //   Sigma_pp - Sigma_pc * Sigma_cc^-1 * Sigma_cp = L_pp * L_pp^T
+    // so the conditional distribution only needs triangular solves.
+    matrix<Type> L;
+
+    // L_cc^-1 * (x_c - mu_c)
+    column whitened_conditioned(
+      const vector<Type>& x,
+      const vector<Type>& mu
+    );
   public:
     conditional_normal(
       const matrix<Type>& full_sigma,
@@ -30,45 +42,102 @@ class conditional_normal {
       const vector<Type>& x,
       const vector<Type>& mu
     );
+    template<class RNG>
+    vector<Type> simulate(
+      const vector<Type>& x,
+      const vector<Type>& mu,
+      RNG& rng
+    );
 
     // Compute condiitonal covariance matrix
-    matrix<Type> conditional_cov() { return mvn.cov(); }
+    matrix<Type> conditional_cov() {
+      matrix<Type> L_pp = L.bottomRightCorner(np, np);
+      return L_pp * L_pp.transpose();
+    }
+
+    // Cholesky factor of the conditional covariance matrix
+    matrix<Type> conditional_cholesky() { return L.bottomRightCorner(np, np); }
+
+    // Sigma_pc * Sigma_cc^-1
+    matrix<Type> regression();
 };
 
 
+// Lower Cholesky factor, written out so it records a plain operation sequence
+// for AD types
+template<class Type>
+matrix<Type> lower_cholesky(const matrix<Type>& A) {
+  instrumentation::get().count_factorisation();
+  int n = A.rows();
+  matrix<Type> L(n, n);
+  L.setZero();
+  for(int j = 0; j < n; j++) {
+    Type diag = A(j, j);
+    for(int k = 0; k < j; k++) {
+      diag -= L(j, k) * L(j, k);
+    }
+    L(j, j) = sqrt(diag);
+    for(int i = j + 1; i < n; i++) {
+      Type off = A(i, j);
+      for(int k = 0; k < j; k++) {
+        off -= L(i, k) * L(j, k);
+      }
+      L(i, j) = off / L(j, j);
+    }
+  }
+  return L;
+}
 
 template<class Type>
 conditional_normal<Type>::conditional_normal(
     const matrix<Type>& full_sigma,
     int nc) :
-    full_sigma{full_sigma},
     nc{nc},
     np{static_cast<int>(full_sigma.rows()) - nc} {
-  matrix<Type> sigma11 = full_sigma.topLeftCorner(np, np);
-  matrix<Type> sigma12 = full_sigma.topRightCorner(np, nc);
-  matrix<Type> sigma22 = full_sigma.bottomRightCorner(nc, nc);
-  matrix<Type> inv22 = sigma22;
-  if( inv22.rows() > 0 ) {
-    inv22 = atomic::matinv(inv22);
+  // Move the conditioned components to the front
+  vector<int> order(full_sigma.rows());
+  for(int i = 0; i < nc; i++) {
+    order(i) = np + i;
+  }
+  for(int i = 0; i < np; i++) {
+    order(nc + i) = i;
+  }
+  matrix<Type> reordered(full_sigma.rows(), full_sigma.cols());
+  for(int i = 0; i < reordered.rows(); i++) {
+    for(int j = 0; j < reordered.cols(); j++) {
+      reordered(i, j) = full_sigma(order(i), order(j));
+    }
+  }
+  L = lower_cholesky(reordered);
+}
+
+template<class Type>
+typename conditional_normal<Type>::column conditional_normal<Type>::whitened_conditioned(
+    const vector<Type>& x,
+    const vector<Type>& mu) {
+  column r = (x.segment(np, nc) - mu.segment(np, nc)).matrix();
+  if( nc > 0 ) {
+    L.topLeftCorner(nc, nc).template triangularView<Eigen::Lower>().solveInPlace(r);
   } else {}
+  return r;
+}
 
-  c_sigma_inv = sigma12 * inv22;
-  matrix<Type> sigma_p = sigma11 - c_sigma_inv * sigma12.transpose();
-  mvn = MVNORM_t<Type>(sigma_p);
+template<class Type>
+matrix<Type> conditional_normal<Type>::regression() {
+  matrix<Type> A = L.bottomLeftCorner(np, nc);
+  if( nc > 0 ) {
+    L.topLeftCorner(nc, nc).template triangularView<Eigen::Lower>()
+      .template solveInPlace<Eigen::OnTheRight>(A);
+  } else {}
+  return A;
 }
 
 template<class Type>
 vector<Type> conditional_normal<Type>::conditional_mean(
     const vector<Type>& x,
     const vector<Type>& mu) {
-  vector<Type> x_p = x.segment(0, np);
-  vector<Type> mu_p = mu.segment(0, np);
-  vector<Type> x_c = x.segment(np, nc);
-  vector<Type> mu_c = mu.segment(np, nc);
-
-  vector<Type> conditional_mean = mu_p + vector<Type>(
-    c_sigma_inv * (x_c - mu_c).matrix()
-  );
+  column shift = L.bottomLeftCorner(np, nc) * whitened_conditioned(x, mu);
+  vector<Type> conditional_mean = mu.segment(0, np) + shift.array();
 
   return conditional_mean;
 }
@@ -77,17 +146,36 @@ template<class Type>
 Type conditional_normal<Type>::loglikelihood(
     const vector<Type>& x,
     const vector<Type>& mu) {
-  vector<Type> x_p = x.segment(0, np);
-  vector<Type> mu_p = conditional_mean(x, mu);
-  return -1.0 * mvn(x_p - mu_p);
+  column r = (x.segment(0, np) - conditional_mean(x, mu)).matrix();
+  L.bottomRightCorner(np, np).template triangularView<Eigen::Lower>().solveInPlace(r);
+
+  Type ll = -0.5 * r.squaredNorm() - 0.5 * np * log(2.0 * M_PI);
+  for(int i = 0; i < np; i++) {
+    ll -= log(L(nc + i, nc + i));
+  }
+  return ll;
 }
 
 template<class Type>
 vector<Type> conditional_normal<Type>::simulate(
     const vector<Type>& x,
     const vector<Type>& mu) {
-  vector<Type> mu_p = conditional_mean(x, mu);
-  vector<Type> x_p = mvn.simulate() + mu_p;
+  r_rng<Type> rng;
+  return simulate(x, mu, rng);
+}
+
+template<class Type>
+template<class RNG>
+vector<Type> conditional_normal<Type>::simulate(
+    const vector<Type>& x,
+    const vector<Type>& mu,
+    RNG& rng) {
+  column z(np);
+  for(int i = 0; i < np; i++) {
+    z(i) = rng.normal();
+  }
+  column noise = L.bottomRightCorner(np, np).template triangularView<Eigen::Lower>() * z;
+  vector<Type> x_p = conditional_mean(x, mu) + noise.array();
 
   return x_p;
 }
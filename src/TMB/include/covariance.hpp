@@ -1,14 +1,440 @@
+// Radial profiles of the covariance functions used for the derivative processes.
+//
+// Every covariance function is stationary and isotropic, C(x1, x2) = f(r) with
+// r = d(x1, x2) and h = x1 - x2. Writing
+//   g(r) = f'(r) / r and k(r) = g'(r) / r
+// the derivatives needed for the joint (w, dw/dx, dw/dy) process are
+//   dC / dx1_a = g(r) * h_a
+//   dC / dx2_b = -g(r) * h_b
+//   d2C / dx1_a dx2_b = -k(r) * h_a * h_b - g(r) * delta_ab
+// so each profile only has to supply f, g, and k.
+//
+// constants(pars) gathers everything eval needs that only depends on the
+// parameters, so a covariance_kernel computes it once and the per entry cost,
+// and the per entry AD tape, only covers the terms in r.
+//
+// eval_batch evaluates a profile for many distances in plain double as Eigen
+// array expressions, so exp and sqrt use Eigen's SIMD packet math.
+template<int covar_code> struct radial_profile;
+
+// Exponential [sd, range]
+template<>
+struct radial_profile<0> {
+  // [sd^2, 1 / range, range]
+  template<typename T>
+  static vector<T> constants(const vector<T>& pars) {
+    vector<T> c(3);
+    c << pars(0) * pars(0), 1 / pars(1), pars(1);
+    return c;
+  }
+  template<typename T>
+  static void eval(T r, const vector<T>& c, T& f, T& g, T& k) {
+    f = c(0) * exp( -r * c(1) );
+    g = -f * c(1) / r;
+    k = f * (r + c(2)) * c(1) * c(1) / (r * r * r);
+  }
+  static void eval_batch(const Eigen::ArrayXd& r, const vector<double>& c, Eigen::ArrayXd& f, Eigen::ArrayXd& g, Eigen::ArrayXd& k) {
+    f = c(0) * (-r * c(1)).exp();
+    g = -f * c(1) / r;
+    k = f * (r + c(2)) * c(1) * c(1) / r.cube();
+  }
+};
+
+// Gaussian [marg_sd, range]
+template<>
+struct radial_profile<1> {
+  // [sd^2, -1 / (2 range^2), -1 / range^2, 1 / range^4]
+  template<typename T>
+  static vector<T> constants(const vector<T>& pars) {
+    vector<T> c(4);
+    T inv_range2 = 1 / (pars(1) * pars(1));
+    c << pars(0) * pars(0), -0.5 * inv_range2, -inv_range2, inv_range2 * inv_range2;
+    return c;
+  }
+  template<typename T>
+  static void eval(T r, const vector<T>& c, T& f, T& g, T& k) {
+    f = c(0) * exp( c(1) * r * r );
+    g = c(2) * f;
+    k = c(3) * f;
+  }
+  static void eval_batch(const Eigen::ArrayXd& r, const vector<double>& c, Eigen::ArrayXd& f, Eigen::ArrayXd& g, Eigen::ArrayXd& k) {
+    f = c(0) * (c(1) * r.square()).exp();
+    g = c(2) * f;
+    k = c(3) * f;
+  }
+};
+
+// Matern [sd, range, nu]
+// Uses d/dx [x^nu K_nu(x)] = -x^nu K_{nu - 1}(x) and K_{-nu} = K_nu.
+template<>
+struct radial_profile<2> {
+  // [sd^2, range, nu, sd^2 / (Gamma(nu) 2^(nu - 1)), 1 / range, 1 / range^2,
+  //  1 / range^4, nu - 1, |nu - 1|, nu - 2, |nu - 2|]
+  template<typename T>
+  static vector<T> constants(const vector<T>& pars) {
+    vector<T> c(11);
+    T inv_range = 1 / pars(1);
+    c << pars(0) * pars(0),
+      pars(1),
+      pars(2),
+      pars(0) * pars(0) / ( exp(lgamma(pars(2))) * pow(T(2.0), pars(2) - 1.0) ),
+      inv_range,
+      inv_range * inv_range,
+      inv_range * inv_range * inv_range * inv_range,
+      pars(2) - 1.0,
+      abs(pars(2) - 1.0),
+      pars(2) - 2.0,
+      abs(pars(2) - 2.0);
+    return c;
+  }
+  template<typename T>
+  static void eval(T r, const vector<T>& c, T& f, T& g, T& k) {
+    T x = r * c(4);
+    f = c(0) * matern(r, c(1), c(2));
+    g = -c(3) * pow(x, c(7)) * besselK(x, c(8)) * c(5);
+    k = c(3) * pow(x, c(9)) * besselK(x, c(10)) * c(6);
+  }
+  // besselK has no packet form, so the batch is evaluated entry by entry
+  static void eval_batch(const Eigen::ArrayXd& r, const vector<double>& c, Eigen::ArrayXd& f, Eigen::ArrayXd& g, Eigen::ArrayXd& k) {
+    f.resize(r.size());
+    g.resize(r.size());
+    k.resize(r.size());
+    for(int i = 0; i < r.size(); i++) {
+      eval(r(i), c, f(i), g(i), k(i));
+    }
+  }
+};
+
+// Matern32 [sd, range]
+template<>
+struct radial_profile<3> {
+  // [sd^2, 1 / range, -sd^2 / range^2, sd^2 / range^3]
+  template<typename T>
+  static vector<T> constants(const vector<T>& pars) {
+    vector<T> c(4);
+    T sd2 = pars(0) * pars(0);
+    T inv_range = 1 / pars(1);
+    c << sd2, inv_range, -sd2 * inv_range * inv_range, sd2 * inv_range * inv_range * inv_range;
+    return c;
+  }
+  template<typename T>
+  static void eval(T r, const vector<T>& c, T& f, T& g, T& k) {
+    T x = r * c(1);
+    T e = exp( -x );
+    f = c(0) * (1 + x) * e;
+    g = c(2) * e;
+    k = c(3) * e / r;
+  }
+  static void eval_batch(const Eigen::ArrayXd& r, const vector<double>& c, Eigen::ArrayXd& f, Eigen::ArrayXd& g, Eigen::ArrayXd& k) {
+    Eigen::ArrayXd x = r * c(1);
+    Eigen::ArrayXd e = (-x).exp();
+    f = c(0) * (1 + x) * e;
+    g = c(2) * e;
+    k = c(3) * e / r;
+  }
+};
+
+// Number of terms n when the Matern smoothness is nu = n + 1/2, or -1 if it is
+// not a half integer
+inline int half_integer_order(double nu) {
+  double n = nu - 0.5;
+  if( n < -1e-8 || n > 50 || std::abs(n - std::round(n)) > 1e-8 ) {
+    return -1;
+  } else {}
+  return int(std::round(n));
+}
+
+// Matern [sd, range, nu] with nu = n + 1/2, selected by covariance::dispatch.
+// Half integer Bessel functions have the closed form
+//   x^mu K_|mu|(x) = sqrt(pi / 2) e^-x sum_j a_mj x^(p - j),  m = |mu| - 1/2
+// with a_mj = (m + j)! / (j! (m - j)! 2^j), and p = m for mu > 0, -m - 1 for
+// mu < 0, so f, g, and k are polynomials in x and 1 / x times e^-x. The order
+// of the polynomial follows the value of nu, so an AD tape using it has no
+// derivative with respect to nu and it is only used when nu is a constant.
+template<>
+struct radial_profile<4> {
+  // x^mu K_|mu|(x) with mu = twice_mu / 2 and e = exp(-x)
+  template<typename X>
+  static X scaled_besselK(const X& x, const X& e, int twice_mu) {
+    int m = (std::abs(twice_mu) - 1) / 2;
+    int p = twice_mu > 0 ? m : -m - 1;
+    X t = sqrt(M_PI / 2) * e;
+    for(int i = 0; i < std::abs(p); i++) {
+      t = p > 0 ? X(t * x) : X(t / x);
+    }
+    X s = t;
+    double a = 1.0;
+    for(int j = 1; j <= m; j++) {
+      a *= (m + j) * (m - j + 1) / (2.0 * j);
+      t = t / x;
+      s = s + a * t;
+    }
+    return s;
+  }
+
+  // [sd^2 / (Gamma(nu) 2^(nu - 1)), 1 / range, -1 / range^2, 1 / range^4, n]
+  template<typename T>
+  static vector<T> constants(const vector<T>& pars) {
+    int n = half_integer_order(asDouble(pars(2)));
+    double nu = n + 0.5;
+    vector<T> c(5);
+    T inv_range = 1 / pars(1);
+    c << pars(0) * pars(0) / ( std::exp(std::lgamma(nu)) * std::pow(2.0, nu - 1.0) ),
+      inv_range,
+      -inv_range * inv_range,
+      inv_range * inv_range * inv_range * inv_range,
+      T(n);
+    return c;
+  }
+
+  template<typename X, typename S>
+  static void eval_half(const X& r, const vector<S>& c, X& f, X& g, X& k) {
+    int n = int(asDouble(c(4)));
+    X x = r * c(1);
+    X e = exp(-x);
+    f = c(0) * scaled_besselK(x, e, 2 * n + 1);
+    g = c(0) * c(2) * scaled_besselK(x, e, 2 * n - 1);
+    k = c(0) * c(3) * scaled_besselK(x, e, 2 * n - 3);
+  }
+
+  template<typename T>
+  static void eval(T r, const vector<T>& c, T& f, T& g, T& k) {
+    eval_half(r, c, f, g, k);
+  }
+  static void eval_batch(const Eigen::ArrayXd& r, const vector<double>& c, Eigen::ArrayXd& f, Eigen::ArrayXd& g, Eigen::ArrayXd& k) {
+    eval_half(r, c, f, g, k);
+  }
+};
+
+// Table of F_j(x) = x^(nu - j) K_|nu - j|(x), j = 0, ..., 3, for one Matern
+// smoothness nu > 3 on a grid in x = r / range. Between nodes F_0, F_1, and
+// F_2 are cubic Hermite interpolants using F_j'(x) = -x F_(j + 1)(x). The
+// table only depends on nu, so each thread builds it once.
+class matern_table {
+  private:
+    double nu = -1.0;
+    matrix<double> F; // n_nodes x 4
+
+    void build(double new_nu) {
+      nu = new_nu;
+      scale = 1.0 / ( std::exp(std::lgamma(nu)) * std::pow(2.0, nu - 1.0) );
+      F.resize(n_nodes, 4);
+      for(int j = 0; j < 4; j++) {
+        // x^mu K_mu(x) -> Gamma(mu) 2^(mu - 1) as x -> 0
+        F(0, j) = std::exp(std::lgamma(nu - j)) * std::pow(2.0, nu - j - 1.0);
+        for(int i = 1; i < n_nodes; i++) {
+          double x = i * spacing;
+          F(i, j) = std::pow(x, nu - j) * besselK(x, std::abs(nu - j));
+        }
+      }
+    }
+
+  public:
+    static const int n_nodes = 4001;
+    static constexpr double x_max = 50.0;
+    static constexpr double spacing = x_max / (n_nodes - 1);
+    double scale; // 1 / (Gamma(nu) 2^(nu - 1))
+
+    static const matern_table& get(double nu) {
+      thread_local matern_table table;
+      if( table.nu != nu ) {
+        table.build(nu);
+      } else {}
+      return table;
+    }
+
+    // F_0, F_1, F_2 at x < x_max
+    template<typename T>
+    void eval(T x, T& F0, T& F1, T& F2) const {
+      int i = std::min(int(asDouble(x) / spacing), n_nodes - 2);
+      double x0 = i * spacing;
+      double x1 = x0 + spacing;
+      T t = (x - x0) / spacing;
+      T t2 = t * t;
+      T t3 = t2 * t;
+      T h00 = 2 * t3 - 3 * t2 + 1;
+      T h10 = (t3 - 2 * t2 + t) * spacing;
+      T h01 = -2 * t3 + 3 * t2;
+      T h11 = (t3 - t2) * spacing;
+      T* out[3] = {&F0, &F1, &F2};
+      for(int j = 0; j < 3; j++) {
+        *out[j] = h00 * F(i, j) - h10 * x0 * F(i, j + 1)
+          + h01 * F(i + 1, j) - h11 * x1 * F(i + 1, j + 1);
+      }
+    }
+};
+
+// Matern [sd, range, nu] with general nu > 3 from matern_table, selected by
+// covariance::dispatch for plain double only, since the interpolation
+// interval is picked from the value of r. Beyond the table it falls back to
+// radial_profile<2>, whose constants it shares.
+template<>
+struct radial_profile<5> {
+  template<typename T>
+  static vector<T> constants(const vector<T>& pars) {
+    return radial_profile<2>::constants(pars);
+  }
+  template<typename T>
+  static void eval(T r, const vector<T>& c, T& f, T& g, T& k) {
+    T x = r * c(4);
+    if( asDouble(x) >= matern_table::x_max ) {
+      radial_profile<2>::eval(r, c, f, g, k);
+      return;
+    } else {}
+    const matern_table& table = matern_table::get(asDouble(c(2)));
+    T F0, F1, F2;
+    table.eval(x, F0, F1, F2);
+    T scale = c(0) * table.scale;
+    f = scale * F0;
+    g = -scale * F1 * c(5);
+    k = scale * F2 * c(6);
+  }
+  static void eval_batch(const Eigen::ArrayXd& r, const vector<double>& c, Eigen::ArrayXd& f, Eigen::ArrayXd& g, Eigen::ArrayXd& k) {
+    f.resize(r.size());
+    g.resize(r.size());
+    k.resize(r.size());
+    for(int i = 0; i < r.size(); i++) {
+      eval(r(i), c, f(i), g(i), k(i));
+    }
+  }
+};
+
+// Fixed size 2d coordinates for covariance_kernel
+template<typename T> using point2 = Eigen::Matrix<T, 2, 1>;
+
+template<class V>
+point2<typename V::Scalar> as_point(const V& x) {
+  return point2<typename V::Scalar>(x(0), x(1));
+}
+
+// Structure of arrays points and variables for covariance_kernel::block
+template<typename T>
+struct point_batch {
+  Eigen::Array<T, Dynamic, 1> x;
+  Eigen::Array<T, Dynamic, 1> y;
+  Eigen::Array<int, Dynamic, 1> v;
+
+  point_batch(int n) : x(n), y(n), v(n) {};
+
+  int size() const { return v.size(); }
+  void set(int i, const point2<T>& p, int var) {
+    x(i) = p(0);
+    y(i) = p(1);
+    v(i) = var;
+  }
+  point2<T> point(int i) const { return point2<T>(x(i), y(i)); }
+};
+
+// Closed form covariance between (v1, v2) in {0 = g, 1 = dx, 2 = dy} for one
+// covariance function. The profile constants are computed once when the
+// kernel is made, so an evaluation is straight-line code without allocations.
+template<int code, typename T>
+class covariance_kernel {
+  private:
+    vector<T> c; // radial_profile<code>::constants
+
+    void block(const point_batch<T>& a, const point_batch<T>& b, matrix<T>& out, std::true_type) const;
+    void block(const point_batch<T>& a, const point_batch<T>& b, matrix<T>& out, std::false_type) const;
+  public:
+    covariance_kernel(const vector<T>& pars) : c(radial_profile<code>::constants(pars)) {};
+
+    T operator() (const point2<T>& x1, const point2<T>& x2, int v1, int v2) const {
+      T h0 = x1(0) - x2(0);
+      T h1 = x1(1) - x2(1);
+      T r = sqrt(h0 * h0 + h1 * h1 + T(1e-6));
+      T f, g, k;
+      radial_profile<code>::eval(r, c, f, g, k);
+
+      T ha = v1 == 2 ? h1 : h0;
+      T hb = v2 == 2 ? h1 : h0;
+      if( v1 == 0 && v2 == 0 ) {
+        // g_g
+        return f;
+      } else if( v1 == 0 ) {
+        // g_dx, g_dy
+        return -g * hb;
+      } else if( v2 == 0 ) {
+        // dx_g, dy_g
+        return g * ha;
+      } else {
+        // dx_dx, dx_dy, dy_dx, dy_dy
+        return v1 == v2 ? -k * ha * hb - g : -k * ha * hb;
+      }
+    }
+
+    // out(i, j) is the covariance between a(i) and b(j). Plain double fills
+    // each column with array expressions, AD types use the scalar kernel and
+    // only record the lower triangle of a symmetric block(a, a, out). The
+    // instrumentation counts the entries once per block, not per entry.
+    void block(const point_batch<T>& a, const point_batch<T>& b, matrix<T>& out) const {
+      out.resize(a.size(), b.size());
+      block(a, b, out, std::is_same<T, double>());
+    }
+};
+
+template<int code, typename T>
+void covariance_kernel<code, T>::block(const point_batch<T>& a, const point_batch<T>& b, matrix<T>& out, std::true_type) const {
+  instrumentation::get().count_sigma_entries(a.size() * b.size());
+  Eigen::ArrayXd r, f, g, k;
+  for(int j = 0; j < b.size(); j++) {
+    Eigen::ArrayXd h0 = a.x - b.x(j);
+    Eigen::ArrayXd h1 = a.y - b.y(j);
+    r = (h0.square() + h1.square() + 1e-6).sqrt();
+    radial_profile<code>::eval_batch(r, c, f, g, k);
+
+    Eigen::ArrayXd ha = (a.v == 2).select(h1, h0);
+    if( b.v(j) == 0 ) {
+      // g_g, dx_g, dy_g
+      out.col(j) = (a.v == 0).select(f, g * ha).matrix();
+    } else {
+      // g_dx, g_dy, then dx_dx, dx_dy, dy_dx, dy_dy
+      Eigen::ArrayXd hb = b.v(j) == 2 ? h1 : h0;
+      Eigen::ArrayXd same = (a.v == b.v(j)).select(g, Eigen::ArrayXd::Zero(a.size()));
+      out.col(j) = (a.v == 0).select(-g * hb, -k * ha * hb - same).matrix();
+    }
+  }
+}
+
+template<int code, typename T>
+void covariance_kernel<code, T>::block(const point_batch<T>& a, const point_batch<T>& b, matrix<T>& out, std::false_type) const {
+  if( &a == &b ) {
+    instrumentation::get().count_sigma_entries(a.size() * (a.size() + 1) / 2);
+    for(int i = 0; i < a.size(); i++) {
+      for(int j = 0; j <= i; j++) {
+        out(i, j) = (*this)(a.point(i), a.point(j), a.v(i), a.v(j));
+        out(j, i) = out(i, j);
+      }
+    }
+    return;
+  } else {}
+  instrumentation::get().count_sigma_entries(a.size() * b.size());
+  for(int i = 0; i < a.size(); i++) {
+    for(int j = 0; j < b.size(); j++) {
+      out(i, j) = (*this)(a.point(i), b.point(j), a.v(i), b.v(j));
+    }
+  }
+}
+
+// Is the Matern smoothness flagged as fixed in the data list, e.g. because it
+// is mapped? It's optional so existing data lists don't need it.
+template<class Type>
+bool smoothness_fixed(objective_function<Type>* obj) {
+  SEXP flag = getListElement(obj->data, "fixed_smoothness");
+  return !Rf_isNull(flag) && asInteger(flag) == 1;
+}
+
 template<class Type>
 class covariance {
   private:
     vector<Type> pars;
     int covar_code; // Which covariance function to use?
+    bool fixed_smoothness; // Is the Matern nu a constant, e.g. mapped in R?
 
   public:
     // Constructor
-    covariance(const vector<Type>& pars, const int& covar_code) :
-      pars{pars}, covar_code{covar_code} {};
-    covariance() : pars{vector<Type>()}, covar_code(0) {};
+    covariance(const vector<Type>& pars, const int& covar_code, bool fixed_smoothness = false) :
+      pars{pars}, covar_code{covar_code}, fixed_smoothness{fixed_smoothness} {};
+    covariance() : pars{vector<Type>()}, covar_code(0), fixed_smoothness(false) {};
 
     // Squared distance function
     template<typename T> T d(const vector<T>& x1, const vector<T>& x2);
@@ -19,7 +445,21 @@ class covariance {
     template<typename T> vector<T> gradient(const vector<T>& x1, const vector<T>& x2);
     template<typename T> matrix<T> hessian(const vector<T>& x1, const vector<T>& x2);
 
+    // Closed form covariance between (v1, v2) in {0 = g, 1 = dx, 2 = dy}
     template<typename T> T operator() (const vector<T>& x1, const vector<T>& x2, int v1, int v2);
+
+    // Call f(kernel) with the covariance_kernel for covar_code, so a loop of
+    // covariance evaluations in f is compiled for a single covariance function
+    // and only switches on covar_code once. The Matern uses the closed forms
+    // of radial_profile<4> for half integer smoothness in plain double or when
+    // the smoothness is fixed, and the table of radial_profile<5> for other
+    // smoothness above 3 in plain double. Otherwise an AD tape keeps its
+    // derivative with respect to nu through radial_profile<2>.
+    template<class F> void dispatch(F f);
+    template<int code, typename T> T derivative(const vector<T>& x1, const vector<T>& x2, int v1, int v2);
+
+    // Same as above, but found by differentiating operator() (x1, x2) with nested AD
+    template<typename T> T ad_derivative(const vector<T>& x1, const vector<T>& x2, int v1, int v2);
 };
 
 template<class Type>
@@ -79,9 +519,49 @@ matrix<T> covariance<Type>::hessian(const vector<T>& x1, const vector<T>& x2) {
   return autodiff::hessian(*this, x1x2);
 }
 
+template<class Type>
+template<class F>
+void covariance<Type>::dispatch(F f) {
+  switch(covar_code) {
+    case 0 : f(covariance_kernel<0, Type>(pars)); break;
+    case 1 : f(covariance_kernel<1, Type>(pars)); break;
+    case 2 :
+      if( (std::is_same<Type, double>::value || fixed_smoothness) && half_integer_order(asDouble(pars(2))) >= 0 ) {
+        f(covariance_kernel<4, Type>(pars));
+      } else if( std::is_same<Type, double>::value && asDouble(pars(2)) > 3.0 ) {
+        f(covariance_kernel<5, Type>(pars));
+      } else {
+        f(covariance_kernel<2, Type>(pars));
+      }
+      break;
+    case 3 : f(covariance_kernel<3, Type>(pars)); break;
+    default : f(covariance_kernel<1, Type>(pars)); break;
+  }
+}
+
 template<class Type>
 template<typename T>
 T covariance<Type>::operator() (const vector<T>& x1, const vector<T>& x2, int v1, int v2) {
+  switch(covar_code) {
+    case 0 : return derivative<0>(x1, x2, v1, v2);
+    case 1 : return derivative<1>(x1, x2, v1, v2);
+    case 2 : return derivative<2>(x1, x2, v1, v2);
+    case 3 : return derivative<3>(x1, x2, v1, v2);
+    default : return derivative<1>(x1, x2, v1, v2);
+  }
+}
+
+template<class Type>
+template<int code, typename T>
+T covariance<Type>::derivative(const vector<T>& x1, const vector<T>& x2, int v1, int v2) {
+  instrumentation::get().count_sigma_entry();
+  covariance_kernel<code, T> kernel(this->pars.template cast<T>());
+  return kernel(as_point(x1), as_point(x2), v1, v2);
+}
+
+template<class Type>
+template<typename T>
+T covariance<Type>::ad_derivative(const vector<T>& x1, const vector<T>& x2, int v1, int v2) {
   T ans = 0.0;
   // operator() (x, y), (x, y)
   // (x, y), (x, y) [g_g]
@@ -1,53 +1,224 @@
 template<class Type>
 class nngp_graph {
+  public:
+    // View of vertex rows [x_idx, y_idx, var] stored in the graph
+    typedef Eigen::Map<const Eigen::Matrix<int, Dynamic, 3, Eigen::RowMajor> > vertex_map;
   private:
     vector<Type> x_coordinates;
     vector<Type> y_coordinates;
-    vector<matrix<int> > to_list;
-    vector<matrix<int> > from_list;
+
+    // Vertices of every node stored back to back as [to; from], row-major.
+    // Node i uses rows offsets[i] to offsets[i + 1] - 1, the first n_to[i] of
+    // which are its "to" vertices.
+    std::vector<int> vertices;
+    std::vector<int> offsets {0};
+    std::vector<int> n_to;
+
+    // Topological levels, nodes in a level only have parents in earlier levels
+    // so they can be handled in any order. Level l is nodes
+    // level_nodes[level_offsets[l]] to level_nodes[level_offsets[l + 1] - 1].
+    // Only simulation uses them, so they are found on the first n_levels()
+    // call instead of on every DATA_STRUCT construction.
+    std::vector<int> level_offsets;
+    std::vector<int> level_nodes;
+    void find_levels();
+
+    // Nodes with the same pattern have the same covariance matrix. Found on
+    // the first n_patterns() call, like the levels.
+    std::vector<int> pattern_ids; // pattern_ids[i] = pattern of node i
+    std::vector<int> representatives; // representatives[p] = first node with pattern p
+    void find_patterns();
+
+    void add_node(const matrix<int>& to, const matrix<int>& from) {
+      for(int i = 0; i < to.rows(); i++) {
+        for(int j = 0; j < 3; j++) vertices.push_back(to(i, j));
+      }
+      for(int i = 0; i < from.rows(); i++) {
+        for(int j = 0; j < 3; j++) vertices.push_back(from(i, j));
+      }
+      n_to.push_back(to.rows());
+      offsets.push_back(offsets.back() + to.rows() + from.rows());
+    }
   public:
     nngp_graph(
       const vector<Type>& x_coordinates,
       const vector<Type>& y_coordinates,
       const vector<matrix<int> >& to_list,
       const vector<matrix<int> >& from_list
-    ) : x_coordinates(x_coordinates), to_list(to_list), from_list(from_list) {};
+    ) : x_coordinates(x_coordinates), y_coordinates(y_coordinates) {
+      for(int i = 0; i < to_list.size(); i++) {
+        add_node(to_list(i), from_list(i));
+      }
+    };
     nngp_graph(SEXP r_list) :
         x_coordinates(asVector<Type>(VECTOR_ELT(r_list, 0))),
         y_coordinates(asVector<Type>(VECTOR_ELT(r_list, 1))) {
       SEXP r_to = VECTOR_ELT(r_list, 2);
-      to_list.resize(LENGTH(r_to));
-
       SEXP r_from = VECTOR_ELT(r_list, 3);
-      from_list.resize(LENGTH(r_from));
-
       for(int i = 0; i < LENGTH(r_to); i++) {
-        to_list(i) = asMatrix<int>(VECTOR_ELT(r_to, i));
-        from_list(i) = asMatrix<int>(VECTOR_ELT(r_from, i));
+        add_node(
+          asMatrix<int>(VECTOR_ELT(r_to, i)),
+          asMatrix<int>(VECTOR_ELT(r_from, i))
+        );
       }
     };
     nngp_graph() = default;
 
-    int size() { return to_list.size(); }
+    int size() { return n_to.size(); }
+
+    // Are the x & y coordinates evenly spaced?
+    bool is_regular() {
+      return evenly_spaced(x_coordinates) && evenly_spaced(y_coordinates);
+    }
+    bool evenly_spaced(const vector<Type>& coords) {
+      if( coords.size() < 3 ) return true;
+      double delta = asDouble(coords(1)) - asDouble(coords(0));
+      for(int i = 2; i < coords.size(); i++) {
+        double this_delta = asDouble(coords(i)) - asDouble(coords(i - 1));
+        if( fabs(this_delta - delta) > 1e-8 * fabs(delta) ) return false;
+      }
+      return true;
+    }
 
     // Get x & y coordinates
     vector<Type> get_x_coordinates() { return x_coordinates; };
     vector<Type> get_y_coordinates() { return y_coordinates; };
 
-    // Get coordinates for specific vertex
-    vector<Type> coordinates(const vector<int>& idx) {
+    // Get coordinates for specific vertex, idx = [x_idx, y_idx, ...]
+    template<class Idx>
+    vector<Type> coordinates(const Idx& idx) {
       vector<Type> cc(2);
       cc(0) = x_coordinates(idx(0));
       cc(1) = y_coordinates(idx(1));
       return cc;
     };
 
-    // Get to / from matrices
-    matrix<int> to(int i) { return to_list(i); }
-    matrix<int> from(int i) { return from_list(i); }
-    matrix<int> operator() (int i) {
-      matrix<int> ans(to(i).rows() + from(i).rows(), to(i).cols());
-      ans << to(i), from(i);
-      return ans;
+    template<class Idx>
+    point2<Type> point(const Idx& idx) {
+      return point2<Type>(x_coordinates(idx(0)), y_coordinates(idx(1)));
+    };
+
+    // Get to / from vertices
+    vertex_map to(int i) {
+      return vertex_map(vertices.data() + 3 * offsets[i], n_to[i], 3);
+    }
+    vertex_map from(int i) {
+      return vertex_map(
+        vertices.data() + 3 * (offsets[i] + n_to[i]),
+        offsets[i + 1] - offsets[i] - n_to[i],
+        3
+      );
+    }
+    vertex_map operator() (int i) {
+      return vertex_map(vertices.data() + 3 * offsets[i], offsets[i + 1] - offsets[i], 3);
+    }
+
+    // Topological levels. Call n_levels() before level_size() or level_node(),
+    // outside of any parallel region.
+    int n_levels() {
+      if( level_offsets.empty() ) find_levels();
+      return level_offsets.size() - 1;
+    }
+    int level_size(int l) { return level_offsets[l + 1] - level_offsets[l]; }
+    int level_node(int l, int m) { return level_nodes[level_offsets[l] + m]; }
+
+    // Covariance patterns. Call n_patterns() before pattern() or
+    // representative(), outside of any parallel region.
+    int n_patterns() {
+      if( representatives.empty() ) find_patterns();
+      return representatives.size();
+    }
+    int pattern(int i) { return pattern_ids[i]; }
+    int representative(int p) { return representatives[p]; }
+};
+
+template<class Type>
+void nngp_graph<Type>::find_levels() {
+  int n = size();
+  int nx = x_coordinates.size();
+  int ny = y_coordinates.size();
+  auto vertex_key = [nx, ny](const vertex_map& v, int r) {
+    return v(r, 0) + nx * (v(r, 1) + ny * v(r, 2));
+  };
+
+  // Which node has each vertex as a "to" vertex?
+  std::vector<int> producer(3 * nx * ny, -1);
+  for(int i = 0; i < n; i++) {
+    vertex_map to_vertices = to(i);
+    for(int r = 0; r < to_vertices.rows(); r++) {
+      producer[vertex_key(to_vertices, r)] = i;
+    }
+  }
+
+  // One pass is enough for a graph in topological order (see graph_ordered
+  // in make_nn_graph). Otherwise every node gets its own level.
+  std::vector<int> level(n, 0);
+  int max_level = -1;
+  bool ordered = true;
+  for(int i = 0; i < n && ordered; i++) {
+    vertex_map parents = from(i);
+    for(int r = 0; r < parents.rows(); r++) {
+      int p = producer[vertex_key(parents, r)];
+      if( p >= i ) {
+        ordered = false;
+      } else if( p >= 0 ) {
+        level[i] = std::max(level[i], level[p] + 1);
+      } else {}
+    }
+    max_level = std::max(max_level, level[i]);
+  }
+  if( !ordered ) {
+    for(int i = 0; i < n; i++) level[i] = i;
+    max_level = n - 1;
+  } else {}
+
+  // Counting sort, nodes stay in graph order within a level
+  level_offsets.assign(max_level + 2, 0);
+  for(int i = 0; i < n; i++) {
+    level_offsets[level[i] + 1]++;
+  }
+  for(int l = 0; l <= max_level; l++) {
+    level_offsets[l + 1] += level_offsets[l];
+  }
+  level_nodes.resize(n);
+  std::vector<int> fill(level_offsets.begin(), level_offsets.end() - 1);
+  for(int i = 0; i < n; i++) {
+    level_nodes[fill[level[i]]++] = i;
+  }
+}
+template<class Type>
+void nngp_graph<Type>::find_patterns() {
+  // The covariance function is stationary, so on a regular lattice the
+  // covariance matrix of a node only depends on the offsets of its vertices
+  // relative to the first "to" vertex. Off a regular lattice every node gets
+  // its own pattern.
+  int n = size();
+  pattern_ids.resize(n);
+  if( !is_regular() ) {
+    representatives.resize(n);
+    for(int i = 0; i < n; i++) {
+      pattern_ids[i] = i;
+      representatives[i] = i;
+    }
+    return;
+  }
+
+  std::map<std::vector<int>, int> seen;
+  for(int i = 0; i < n; i++) {
+    vertex_map node_vertices = (*this)(i);
+    std::vector<int> key;
+    key.reserve(1 + 3 * node_vertices.rows());
+    key.push_back(from(i).rows());
+    for(int j = 0; j < node_vertices.rows(); j++) {
+      key.push_back(node_vertices(j, 0) - node_vertices(0, 0));
+      key.push_back(node_vertices(j, 1) - node_vertices(0, 1));
+      key.push_back(node_vertices(j, 2));
     }
-};
\ No newline at end of file
+    auto it = seen.find(key);
+    if( it == seen.end() ) {
+      it = seen.insert(std::make_pair(key, static_cast<int>(representatives.size()))).first;
+      representatives.push_back(i);
+    } else {}
+    pattern_ids[i] = it->second;
+  }
+}
@@ -0,0 +1,106 @@
+// Opt-in cost counters for the phases of an objective function.
+//
+// When the data list has instrument = 1, each phase of the model is wrapped
+// in begin() / end() and the counters are returned with REPORT as a
+// n_phases x 4 matrix with columns
+//   seconds, factorisations, sigma_entries, tape_ops
+// Seconds, factorisations (lower_cholesky calls) and sigma_entries
+// (covariance evaluations) are for the evaluation that produced the report.
+// tape_ops is the number of operations each phase added to the most recent
+// AD tape recorded by this thread. It needs the TMBad framework and is -1
+// otherwise. A phase can be entered several times per evaluation, e.g. once
+// per track, and the counters are summed.
+class instrumentation {
+  public:
+    enum phase {field = 0, predictions = 1, track = 2, pings = 3, n_phases = 4};
+  private:
+    bool enabled = false;
+    int current = -1;
+    std::chrono::steady_clock::time_point started;
+    double tape_at_start = 0.0;
+    matrix<double> counters;
+    vector<double> tape_ops;
+    vector<bool> taped; // Has tape_ops(p) been restarted this evaluation?
+
+    instrumentation() : counters(n_phases, 3), tape_ops(n_phases), taped(n_phases) {
+      counters.setZero();
+      tape_ops.fill(-1.0);
+      taped.fill(false);
+    };
+  public:
+    // One set of counters per thread
+    static instrumentation& get() {
+      static thread_local instrumentation instance;
+      return instance;
+    }
+
+    // Start a new evaluation
+    void reset(bool enable) {
+      enabled = enable;
+      current = -1;
+      counters.setZero();
+      taped.fill(false);
+    }
+
+    template<class Type>
+    void begin(phase p) {
+      if( !enabled ) return;
+      current = p;
+      tape_at_start = tape_size<Type>();
+      started = std::chrono::steady_clock::now();
+    }
+
+    template<class Type>
+    void end() {
+      if( !enabled || current < 0 ) return;
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+      counters(current, 0) += elapsed.count();
+      double tape_now = tape_size<Type>();
+      if( tape_now >= 0 ) {
+        if( !taped(current) ) {
+          tape_ops(current) = 0.0;
+          taped(current) = true;
+        } else {}
+        tape_ops(current) += tape_now - tape_at_start;
+      } else {}
+      current = -1;
+    }
+
+    void count_factorisation() {
+      if( enabled && current >= 0 ) counters(current, 1) += 1.0;
+    }
+    void count_sigma_entry() {
+      if( enabled && current >= 0 ) counters(current, 2) += 1.0;
+    }
+    void count_sigma_entries(int n) {
+      if( enabled && current >= 0 ) counters(current, 2) += n;
+    }
+
+    matrix<double> table() {
+      matrix<double> ans(n_phases, 4);
+      ans.leftCols(3) = counters;
+      ans.col(3) = tape_ops.matrix();
+      return ans;
+    }
+
+    // Number of operations on the tape currently being recorded, -1 if not
+    // available
+    template<class Type>
+    static double tape_size() { return -1.0; }
+};
+
+#ifdef TMBAD_FRAMEWORK
+template<>
+inline double instrumentation::tape_size<TMBad::ad_aug>() {
+  TMBad::global* glob = TMBad::get_glob();
+  return glob == NULL ? -1.0 : static_cast<double>(glob->opstack.size());
+}
+#endif
+
+// Is instrumentation requested in the data list? It's optional so existing
+// data lists don't need it.
+template<class Type>
+bool instrument_requested(objective_function<Type>* obj) {
+  SEXP flag = getListElement(obj->data, "instrument");
+  return !Rf_isNull(flag) && asInteger(flag) == 1;
+}
@@ -0,0 +1,171 @@
+// Exact marginal likelihood of a random walk track observed with Gaussian
+// error, integrating over the true locations with a Kalman filter.
+//
+// The first location has a flat prior, matching loc_track::loglikelihood(),
+// so the state is carried in information form until the first ping. The RTS
+// smoother then gives the conditional mean and standard deviation of each
+// true location given the pings.
+template<class Type>
+class kalman_track {
+  private:
+    vector<Type> time;
+    Type gamma;
+
+    // Predicted and filtered moments for each time
+    vector<vector<Type> > pred_mean;
+    vector<matrix<Type> > pred_cov;
+    vector<vector<Type> > filt_mean;
+    vector<matrix<Type> > filt_cov;
+    int first_informed; // First time with a proper filtered distribution
+
+    // Closed form 2 x 2 determinant and inverse
+    Type det2(const matrix<Type>& A) { return A(0, 0) * A(1, 1) - A(0, 1) * A(1, 0); }
+    matrix<Type> inverse2(const matrix<Type>& A);
+
+    void smooth();
+  public:
+    matrix<Type> smoothed_mean;
+    matrix<Type> smoothed_sd;
+
+    kalman_track(
+      const vector<Type>& time,
+      Type gamma
+    ) : time(time), gamma(gamma) {};
+    kalman_track() = default;
+
+    Type loglikelihood(const matrix<Type>& Sigma, loc_observations<Type>& pings);
+};
+
+template<class Type>
+matrix<Type> kalman_track<Type>::inverse2(const matrix<Type>& A) {
+  Type d = det2(A);
+  matrix<Type> ans(2, 2);
+  ans << A(1, 1) / d, -A(0, 1) / d,
+    -A(1, 0) / d, A(0, 0) / d;
+  return ans;
+}
+
+template<class Type>
+Type kalman_track<Type>::loglikelihood(
+    const matrix<Type>& Sigma,
+    loc_observations<Type>& pings) {
+  int n = time.size();
+
+  // Pings at each time, pings for time t are by_time(time_offsets(t)) to
+  // by_time(time_offsets(t + 1) - 1)
+  vector<int> time_offsets(n + 1);
+  time_offsets.setZero();
+  for(int i = 0; i < pings.size(); i++) {
+    time_offsets(pings.track_idx(i) + 1) += 1;
+  }
+  for(int t = 0; t < n; t++) {
+    time_offsets(t + 1) += time_offsets(t);
+  }
+  vector<int> by_time(pings.size());
+  vector<int> fill = time_offsets.head(n);
+  for(int i = 0; i < pings.size(); i++) {
+    by_time(fill(pings.track_idx(i))++) = i;
+  }
+
+  vector<matrix<Type> > obs_cov(pings.K.rows());
+  vector<matrix<Type> > obs_prec(pings.K.rows());
+  for(int q = 0; q < obs_cov.size(); q++) {
+    obs_cov(q) = pings.conjugate(Sigma, q);
+    obs_prec(q) = inverse2(obs_cov(q));
+  }
+
+  pred_mean.resize(n);
+  pred_cov.resize(n);
+  filt_mean.resize(n);
+  filt_cov.resize(n);
+  first_informed = n;
+
+  Type ll = 0.0;
+  vector<Type> m(2);
+  m.setZero();
+  matrix<Type> P(2, 2);
+  P.setZero();
+  for(int t = 0; t < n; t++) {
+    if( t > first_informed ) {
+      Type step_var = pow(gamma, 2) * (time(t) - time(t - 1));
+      P(0, 0) += step_var;
+      P(1, 1) += step_var;
+    } else {}
+    pred_mean(t) = m;
+    pred_cov(t) = P;
+
+    if( t < first_informed && time_offsets(t + 1) > time_offsets(t) ) {
+      // Integrate out the flat prior using the information form
+      matrix<Type> J(2, 2);
+      J.setZero();
+      vector<Type> h(2);
+      h.setZero();
+      for(int o = time_offsets(t); o < time_offsets(t + 1); o++) {
+        int i = by_time(o);
+        int q = pings.loc_class(i);
+        vector<Type> y(pings.coords.row(i));
+        vector<Type> Ry = (obs_prec(q) * y.matrix()).array();
+        J += obs_prec(q);
+        h += Ry;
+        ll += -log(2.0 * M_PI) - 0.5 * log(det2(obs_cov(q))) - 0.5 * (y * Ry).sum();
+      }
+      P = inverse2(J);
+      m = (P * h.matrix()).array();
+      ll += log(2.0 * M_PI) - 0.5 * log(det2(J)) + 0.5 * (h * m).sum();
+      first_informed = t;
+    } else if( t >= first_informed ) {
+      for(int o = time_offsets(t); o < time_offsets(t + 1); o++) {
+        int i = by_time(o);
+        matrix<Type> S = P + obs_cov(pings.loc_class(i));
+        matrix<Type> S_inv = inverse2(S);
+        vector<Type> v = vector<Type>(pings.coords.row(i)) - m;
+        vector<Type> S_inv_v = (S_inv * v.matrix()).array();
+        ll += -log(2.0 * M_PI) - 0.5 * log(det2(S)) - 0.5 * (v * S_inv_v).sum();
+
+        matrix<Type> gain = P * S_inv;
+        m += (gain * v.matrix()).array();
+        P -= gain * P;
+        P(0, 1) = 0.5 * (P(0, 1) + P(1, 0));
+        P(1, 0) = P(0, 1);
+      }
+    } else {}
+    filt_mean(t) = m;
+    filt_cov(t) = P;
+  }
+
+  smooth();
+
+  return ll;
+}
+
+template<class Type>
+void kalman_track<Type>::smooth() {
+  int n = time.size();
+  smoothed_mean.resize(n, 2);
+  smoothed_sd.resize(n, 2);
+  if( first_informed >= n ) {
+    smoothed_mean.setZero();
+    smoothed_sd.setZero();
+    return;
+  } else {}
+
+  vector<Type> m = filt_mean(n - 1);
+  matrix<Type> P = filt_cov(n - 1);
+  for(int t = n - 1; t >= 0; t--) {
+    if( t < n - 1 && t >= first_informed ) {
+      // RTS step, the random walk has identity transitions
+      matrix<Type> G = filt_cov(t) * inverse2(pred_cov(t + 1));
+      m = filt_mean(t) + (G * (m - pred_mean(t + 1)).matrix()).array();
+      P = filt_cov(t) + G * (P - pred_cov(t + 1)) * G.transpose();
+    } else if( t < first_informed ) {
+      // Before the first ping the track just walks back from the first
+      // informed location
+      Type step_var = pow(gamma, 2) * (time(t + 1) - time(t));
+      P(0, 0) += step_var;
+      P(1, 1) += step_var;
+    } else {}
+    smoothed_mean.row(t) = m.matrix().transpose();
+    smoothed_sd(t, 0) = sqrt(P(0, 0));
+    smoothed_sd(t, 1) = sqrt(P(1, 1));
+  }
+}
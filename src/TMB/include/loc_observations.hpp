@@ -18,24 +18,33 @@ struct loc_observations {
     return diagK * Sigma * diagK;
   };
 
-  Type loglikelihood(const matrix<Type>& Sigma, loc_track<Type>& true_loc);
+  Type loglikelihood(
+    const matrix<Type>& Sigma,
+    loc_track<Type>& true_loc,
+    objective_function<Type>* obj
+  );
   matrix<Type> simulate(const matrix<Type>& Sigma, loc_track<Type>& true_loc);
+  template<class RNG>
+  matrix<Type> simulate(const matrix<Type>& Sigma, loc_track<Type>& true_loc, RNG& rng);
   int size() { return coords.rows(); };
 };
 
 template<class Type>
 Type loc_observations<Type>::loglikelihood(
     const matrix<Type>& Sigma,
-    loc_track<Type>& true_loc) {
-  Type ans = 0.0;
+    loc_track<Type>& true_loc,
+    objective_function<Type>* obj) {
+  // Observation terms are split across OpenMP threads
+  parallel_accumulator<Type> ans(obj);
 
-  vector<MVNORM_t<Type> > obs_mvns(K.rows());
-  for( int q = 0; q < obs_mvns.size(); q++) {
-    obs_mvns(q) = MVNORM_t<Type>(conjugate(Sigma, q));
-  }
+  ping_covariances<Type> obs_cov(Sigma, K);
 
   for(int i = 0; i < coords.rows(); i++) {
-    ans -= obs_mvns(loc_class(i))(vector<Type>(coords.row(i)) - true_loc(track_idx(i)));
+    vector<Type> loc = true_loc(track_idx(i));
+    ans += obs_cov(loc_class(i)).loglikelihood(
+      coords(i, 0) - loc(0),
+      coords(i, 1) - loc(1)
+    );
   }
 
   return ans;
@@ -54,5 +63,32 @@ matrix<Type> loc_observations<Type>::simulate(
     coords.row(i) = obs_mvns(loc_class(i)).simulate() + true_loc(track_idx(i));
   }
 
+  return coords;
+}
+
+template<class Type>
+template<class RNG>
+matrix<Type> loc_observations<Type>::simulate(
+    const matrix<Type>& Sigma,
+    loc_track<Type>& true_loc,
+    RNG& rng) {
+  // Closed form Cholesky factor of each 2 x 2 class covariance
+  vector<matrix<Type> > obs_chol(K.rows());
+  for(int q = 0; q < obs_chol.size(); q++) {
+    matrix<Type> S = conjugate(Sigma, q);
+    obs_chol(q).resize(2, 2);
+    obs_chol(q) << sqrt(S(0, 0)), 0.0,
+      S(1, 0) / sqrt(S(0, 0)), sqrt(S(1, 1) - S(1, 0) * S(1, 0) / S(0, 0));
+  }
+
+  for(int i = 0; i < coords.rows(); i++) {
+    Type z0 = rng.normal();
+    Type z1 = rng.normal();
+    const matrix<Type>& L = obs_chol(loc_class(i));
+    vector<Type> loc = true_loc(track_idx(i));
+    coords(i, 0) = loc(0) + L(0, 0) * z0;
+    coords(i, 1) = loc(1) + L(1, 0) * z0 + L(1, 1) * z1;
+  }
+
   return coords;
 }
\ No newline at end of file
@@ -5,6 +5,9 @@ class loc_track {
     vector<matrix<int> > field_neighbours;
     vector<Type> time;
     Type gamma;
+
+    // dxdx & dydy parents for a set of [x_idx, y_idx] field neighbours
+    matrix<int> gradient_parents(const matrix<int>& nn);
   public:
     matrix<Type> track_gradient;
     loc_track(
@@ -28,17 +31,36 @@ class loc_track {
     };
 
     // If no field, then use random walk
-    Type loglikelihood();
+    Type loglikelihood(objective_function<Type>* obj);
     matrix<Type> simulate();
 
     // If field, then use Langevin diffusion
-    Type loglikelihood(nngp<Type>& field);
+    Type loglikelihood(nngp<Type>& field, objective_function<Type>* obj);
     matrix<Type> simulate(nngp<Type>& field);
+    template<class RNG> matrix<Type> simulate(nngp<Type>& field, RNG& rng);
 };
 
 template<class Type>
-Type loc_track<Type>::loglikelihood() {
-  Type ans = 0.0;
+matrix<int> loc_track<Type>::gradient_parents(const matrix<int>& nn) {
+  matrix<int> parents(2 * nn.rows(), 3);
+  for(int i = 0; i < nn.rows(); i++) {
+    // dxdx neighbours
+    parents(i, 0) = nn(i, 0);
+    parents(i, 1) = nn(i, 1);
+    parents(i, 2) = 1;
+
+    // dydy neighbours
+    parents(i + nn.rows(), 0) = nn(i, 0);
+    parents(i + nn.rows(), 1) = nn(i, 1);
+    parents(i + nn.rows(), 2) = 2;
+  }
+  return parents;
+}
+
+template<class Type>
+Type loc_track<Type>::loglikelihood(objective_function<Type>* obj) {
+  // Steps are split across OpenMP threads
+  parallel_accumulator<Type> ans(obj);
   for(int t = 1; t < coords.rows(); t++) {
     for(int v = 0; v < coords.cols(); v++) {
       ans += dnorm(
@@ -66,8 +88,10 @@ matrix<Type> loc_track<Type>::simulate() {
 }
 
 template<class Type>
-Type loc_track<Type>::loglikelihood(nngp<Type>& field) {
-  Type ans = 0.0;
+Type loc_track<Type>::loglikelihood(nngp<Type>& field, objective_function<Type>* obj) {
+  // Steps are split across OpenMP threads, but every thread needs all of the
+  // track gradients since each step drifts along the previous one
+  parallel_accumulator<Type> ans(obj);
   for(int t = 0; t < coords.rows(); t++) {
     for(int v = 0; v < coords.cols(); v++) {
       if( t > 0 ) {
@@ -79,62 +103,34 @@ Type loc_track<Type>::loglikelihood(nngp<Type>& field) {
         );
       } else {}
     }
-    matrix<int> nn = field_neighbours(t);
-    for(int v = 0; v < coords.cols(); v++) {
-      matrix<int> this_nn(2 * nn.rows(), 3);
-      for(int i = 0; i < nn.rows(); i++) {
-        // dxdx neighbours
-        this_nn(i, 0) = nn(i, 0);
-        this_nn(i, 1) = nn(i, 1);
-        this_nn(i, 2) = 1;
-
-        // dydy neighbours
-        this_nn(i + nn.rows(), 0) = nn(i, 0);
-        this_nn(i + nn.rows(), 1) = nn(i, 1);
-        this_nn(i + nn.rows(), 2) = 2;
-      }
-
-      track_gradient(t, v) = field.predict(
-        v + 1, // 0 = gg, 1 = dxdx, 2 = dydy
-        vector<Type>(coords.row(t)),
-        this_nn
-      );
-    }
+    track_gradient.row(t) = field.predict_gradient(
+      vector<Type>(coords.row(t)),
+      gradient_parents(field_neighbours(t))
+    ).matrix().transpose();
   }
   return ans;
 }
 
 template<class Type>
 matrix<Type> loc_track<Type>::simulate(nngp<Type>& field) {
+  r_rng<Type> rng;
+  return simulate(field, rng);
+}
+
+template<class Type>
+template<class RNG>
+matrix<Type> loc_track<Type>::simulate(nngp<Type>& field, RNG& rng) {
   for(int t = 0; t < coords.rows(); t++) {
     for(int v = 0; v < coords.cols(); v++) {
       if( t > 0 ) {
-        coords(t, v) = rnorm(
-          coords(t - 1, v) + 0.5 * (time(t) - time(t - 1)) * track_gradient(t - 1, v),
-          gamma * pow(time(t) - time(t - 1), 0.5)
-        );
+        coords(t, v) = coords(t - 1, v) + 0.5 * (time(t) - time(t - 1)) * track_gradient(t - 1, v) +
+          gamma * pow(time(t) - time(t - 1), 0.5) * rng.normal();
       } else {}
     }
-    matrix<int> nn = field.find_nearest_four(coords.row(t));
-    for(int v = 0; v < coords.cols(); v++) {
-      matrix<int> this_nn(2 * nn.rows(), 3);
-      for(int i = 0; i < nn.rows(); i++) {
-        // dxdx neighbours
-        this_nn(i, 0) = nn(i, 0);
-        this_nn(i, 1) = nn(i, 1);
-        this_nn(i, 2) = 1;
-
-        // dydy neighbours
-        this_nn(i + nn.rows(), 0) = nn(i, 0);
-        this_nn(i + nn.rows(), 1) = nn(i, 1);
-        this_nn(i + nn.rows(), 2) = 2;
-      }
-      track_gradient(t, v) = field.predict(
-        v + 1, // 0 = gg, 1 = dxdx, 2 = dydy
-        vector<Type>(coords.row(t)),
-        this_nn
-      );
-    }
+    track_gradient.row(t) = field.predict_gradient(
+      vector<Type>(coords.row(t)),
+      gradient_parents(field.find_nearest_four(coords.row(t)))
+    ).matrix().transpose();
   }
   return coords;
 }
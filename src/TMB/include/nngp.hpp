@@ -1,6 +1,8 @@
 template<class Type>
 class nngp {
   private:
+    typedef typename nngp_graph<Type>::vertex_map vertex_map;
+
     nngp_graph<Type> g;
     array<Type> w;
     boundary_mean<Type> boundary;
@@ -9,6 +11,23 @@ class nngp {
     vector<Type> w_node(int idx);
     vector<Type> meanvec(int idx);
     matrix<Type> covmat(int idx);
+    vector<conditional_normal<Type> > pattern_cmvns();
+    template<class RNG>
+    void simulate_node(int idx, vector<conditional_normal<Type> >& cmvns, RNG& rng);
+
+    // Sparse precision form
+    int flat_index(int i, int j, int k) { return i + w.dim(0) * (j + w.dim(1) * k); }
+    std::vector<int> flat_indices(const vertex_map& vertices);
+    vector<Type> mean();
+    vecchia<Type> vecchia_form();
+
+    // Predict several variables / locations from one factorisation of a
+    // shared parent block
+    vector<Type> predict_shared(
+      const matrix<int>& parents,
+      const vector<vector<Type> >& pred_coords,
+      const vector<int>& pred_vars
+    );
   public:
     nngp(
       const nngp_graph<Type>& g,
@@ -18,15 +37,36 @@ class nngp {
     ) : g(g), w(w), boundary(boundary), cv(cv) {};
     nngp() = default;
 
-    Type loglikelihood();
+    Type loglikelihood(objective_function<Type>* obj);
     array<Type> simulate();
+    template<class RNG> array<Type> simulate(RNG& rng);
+    Type sparse_loglikelihood();
+    array<Type> sparse_simulate();
+    template<class RNG> array<Type> sparse_simulate(RNG& rng);
     Type predict(int var, const vector<Type> coords, const matrix<int> parents);
+    void predict(pred_graph<Type>& pwg, vector<Type>& pw);
+    vector<Type> predict_gradient(const vector<Type>& coords, const matrix<int>& parents);
     matrix<int> find_nearest_four(vector<Type> coord);
 };
 
+template<class Type>
+vector<conditional_normal<Type> > nngp<Type>::pattern_cmvns() {
+  // Nodes with the same pattern have the same covariance matrix
+  vector<conditional_normal<Type> > cmvns(g.n_patterns());
+  // Off a regular lattice there is a factorisation per node
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic, 64) if(isDouble<Type>::value)
+#endif
+  for(int p = 0; p < cmvns.size(); p++) {
+    int idx = g.representative(p);
+    cmvns(p) = conditional_normal<Type>(covmat(idx), g.from(idx).rows());
+  }
+  return cmvns;
+}
+
 template<class Type>
 vector<Type> nngp<Type>::w_node(int idx) {
-  matrix<int> vertices = g(idx);
+  vertex_map vertices = g(idx);
   vector<Type> ans(vertices.rows());
   for(int i = 0; i < ans.size(); i++) {
     ans(i) = w(vertices(i, 0), vertices(i, 1), vertices(i, 2));
@@ -36,17 +76,16 @@ vector<Type> nngp<Type>::w_node(int idx) {
 
 template<class Type>
 matrix<Type> nngp<Type>::covmat(int idx) {
-  matrix<int> vertices = g(idx);
-  matrix<Type> ss(vertices.rows(), vertices.rows());
+  vertex_map vertices = g(idx);
+  point_batch<Type> points(vertices.rows());
+  for(int i = 0; i < points.size(); i++) {
+    points.set(i, g.point(vertices.row(i)), vertices(i, 2));
+  }
+  matrix<Type> ss;
+  cv.dispatch([&](const auto& kernel) {
+    kernel.block(points, points, ss);
+  });
   for(int i = 0; i < ss.rows(); i++) {
-    for(int j = 0; j < ss.cols(); j++) {
-      ss(i, j) = cv(
-        g.coordinates(vector<int>(vertices.row(i))),
-        g.coordinates(vector<int>(vertices.row(j))),
-        vertices(i, 2),
-        vertices(j, 2)
-      );
-    }
     ss(i, i) *= 1.001; // Add small number to main diagonal for numerical stability
   }
   return ss;
@@ -54,11 +93,11 @@ matrix<Type> nngp<Type>::covmat(int idx) {
 
 template<class Type>
 vector<Type> nngp<Type>::meanvec(int idx) {
-  matrix<int> vertices = g(idx);
+  vertex_map vertices = g(idx);
   vector<Type> mm(vertices.rows());
   for(int i = 0; i < mm.size(); i++) {
     mm(i) = boundary(
-      g.coordinates(vector<int>(vertices.row(i))),
+      g.coordinates(vertices.row(i)),
       vertices(i, 2)
     );
   }
@@ -66,30 +105,134 @@ vector<Type> nngp<Type>::meanvec(int idx) {
 }
 
 template<class Type>
-Type nngp<Type>::loglikelihood() {
-  Type ll = 0.0;
+Type nngp<Type>::loglikelihood(objective_function<Type>* obj) {
+  // Node terms are split across OpenMP threads
+  parallel_accumulator<Type> ll(obj);
+  vector<conditional_normal<Type> > cmvns = pattern_cmvns();
   for(int i = 0; i < g.size(); i++) {
     vector<Type> this_w = w_node(i);
     vector<Type> mu = meanvec(i);
-    matrix<Type> Sigma = covmat(i);
-    conditional_normal<Type> cmvn(Sigma, g.from(i).rows());
-    ll += cmvn.loglikelihood(this_w, mu);
+    ll += cmvns(g.pattern(i)).loglikelihood(this_w, mu);
   }
   return ll;
 }
 
 template<class Type>
 array<Type> nngp<Type>::simulate() {
+  r_rng<Type> rng;
+  return simulate(rng);
+}
+
+template<class Type>
+template<class RNG>
+array<Type> nngp<Type>::simulate(RNG& rng) {
+  vector<conditional_normal<Type> > cmvns = pattern_cmvns();
+  if( !RNG::splittable ) {
+    for(int i = 0; i < g.size(); i++) {
+      simulate_node(i, cmvns, rng);
+    }
+    return w;
+  } else {}
+
+  // Nodes in a level only read vertices written by earlier levels, so each
+  //   level is split across threads with a random stream per node
+  for(int l = 0; l < g.n_levels(); l++) {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 64) if(isDouble<Type>::value)
+#endif
+    for(int m = 0; m < g.level_size(l); m++) {
+      int i = g.level_node(l, m);
+      RNG node_rng = rng.split(i);
+      simulate_node(i, cmvns, node_rng);
+    }
+  }
+  return w;
+}
+
+template<class Type>
+template<class RNG>
+void nngp<Type>::simulate_node(int idx, vector<conditional_normal<Type> >& cmvns, RNG& rng) {
+  vector<Type> this_w = w_node(idx);
+  vector<Type> mu = meanvec(idx);
+  this_w = cmvns(g.pattern(idx)).simulate(this_w, mu, rng);
+  vertex_map to_vertices = g.to(idx);
+  for(int j = 0; j < to_vertices.rows(); j++) {
+    w(to_vertices(j, 0), to_vertices(j, 1), to_vertices(j, 2)) = this_w(j);
+  }
+}
+
+template<class Type>
+std::vector<int> nngp<Type>::flat_indices(const vertex_map& vertices) {
+  std::vector<int> ans(vertices.rows());
+  for(int i = 0; i < vertices.rows(); i++) {
+    ans[i] = flat_index(vertices(i, 0), vertices(i, 1), vertices(i, 2));
+  }
+  return ans;
+}
+
+template<class Type>
+vector<Type> nngp<Type>::mean() {
+  vector<Type> mu(w.size());
+  mu.setZero();
   for(int i = 0; i < g.size(); i++) {
-    vector<Type> this_w = w_node(i);
-    vector<Type> mu = meanvec(i);
-    matrix<Type> Sigma = covmat(i);
-    conditional_normal<Type> cmvn(Sigma, g.from(i).rows());
-    this_w = cmvn.simulate(this_w, mu);
-    for(int j = 0; j < g.to(i).rows(); j++) {
-      w(g.to(i)(j, 0), g.to(i)(j, 1), g.to(i)(j, 2)) = this_w(j);
+    vertex_map to = g.to(i);
+    for(int j = 0; j < to.rows(); j++) {
+      mu(flat_index(to(j, 0), to(j, 1), to(j, 2))) = boundary(
+        g.coordinates(to.row(j)),
+        to(j, 2)
+      );
     }
   }
+  return mu;
+}
+
+template<class Type>
+vecchia<Type> nngp<Type>::vecchia_form() {
+  vecchia<Type> vf(w.size());
+  for(int i = 0; i < g.size(); i++) {
+    vf.add_vertices(flat_indices(g.to(i)));
+  }
+
+  vector<conditional_normal<Type> > cmvns = pattern_cmvns();
+  vector<matrix<Type> > A(cmvns.size());
+  vector<matrix<Type> > L(cmvns.size());
+  for(int p = 0; p < cmvns.size(); p++) {
+    A(p) = cmvns(p).regression();
+    L(p) = cmvns(p).conditional_cholesky();
+  }
+  for(int i = 0; i < g.size(); i++) {
+    vf.add_node(
+      flat_indices(g.to(i)),
+      flat_indices(g.from(i)),
+      A(g.pattern(i)),
+      L(g.pattern(i))
+    );
+  }
+  return vf;
+}
+
+template<class Type>
+Type nngp<Type>::sparse_loglikelihood() {
+  vector<Type> x(w.size());
+  for(int i = 0; i < x.size(); i++) {
+    x(i) = w(i);
+  }
+  return vecchia_form().loglikelihood(x, mean());
+}
+
+template<class Type>
+array<Type> nngp<Type>::sparse_simulate() {
+  r_rng<Type> rng;
+  return sparse_simulate(rng);
+}
+
+template<class Type>
+template<class RNG>
+array<Type> nngp<Type>::sparse_simulate(RNG& rng) {
+  vector<Type> x = vecchia_form().simulate(mean(), rng);
+  for(int i = 0; i < x.size(); i++) {
+    w(i) = x(i);
+  }
   return w;
 }
 
@@ -109,72 +252,110 @@ Type nngp<Type>::predict(
       mu(i) = boundary(coords, var);
     } else {
       mu(i) = boundary(
-        g.coordinates(vector<int>(parents.row(i - 1))),
+        g.coordinates(parents.row(i - 1)),
         parents(i - 1, 2)
       );
     }
   }
 
-  matrix<Type> Sigma(full_w.size(), full_w.size());
-  for( int i = 0; i < Sigma.rows(); i++ ) {
-    for( int j = 0; j < Sigma.cols(); j++ ) {
-      vector<Type> c1(2);
-      vector<Type> c2(2);
-      int v1;
-      int v2;
-      if( i == 0 ) {
-        c1 = coords;
-        v1 = var;
-      } else {
-        c1 = g.coordinates(vector<int>(parents.row(i - 1)));
-        v1 = parents(i - 1, 2);
-      }
-      if( j == 0 ) {
-        c2 = coords;
-        v2 = var;
-      } else {
-        c2 = g.coordinates(vector<int>(parents.row(j - 1)));
-        v2 = parents(j - 1, 2);
-      }
-
-      Sigma(i, j) = cv(c1, c2, v1, v2);
-    }
+  point_batch<Type> points(full_w.size());
+  points.set(0, as_point(coords), var);
+  for(int i = 0; i < parents.rows(); i++) {
+    points.set(i + 1, g.point(parents.row(i)), parents(i, 2));
   }
+
+  matrix<Type> Sigma;
+  cv.dispatch([&](const auto& kernel) {
+    kernel.block(points, points, Sigma);
+  });
   conditional_normal<Type> cmvn(Sigma, parents.rows());
   full_w(0) = cmvn.conditional_mean(full_w, mu)(0);
 
   return full_w(0);
 }
 
+template<class Type>
+vector<Type> nngp<Type>::predict_shared(
+    const matrix<int>& parents,
+    const vector<vector<Type> >& pred_coords,
+    const vector<int>& pred_vars) {
+  //   pw = mu + (L^-1 Sigma_cp)^T L^-1 (w_c - mu_c), Sigma_cc = L L^T
+  int nc = parents.rows();
+
+  point_batch<Type> points(nc);
+  Eigen::Matrix<Type, Dynamic, 1> resid(nc);
+  for(int i = 0; i < nc; i++) {
+    points.set(i, g.point(parents.row(i)), parents(i, 2));
+    resid(i) = w(parents(i, 0), parents(i, 1), parents(i, 2))
+      - boundary(g.coordinates(parents.row(i)), parents(i, 2));
+  }
+  point_batch<Type> preds(pred_vars.size());
+  for(int m = 0; m < preds.size(); m++) {
+    preds.set(m, as_point(pred_coords(m)), pred_vars(m));
+  }
+
+  // Parent block and the cross covariances of every prediction, column m
+  matrix<Type> Sigma;
+  matrix<Type> cross;
+  cv.dispatch([&](const auto& kernel) {
+    kernel.block(points, points, Sigma);
+    kernel.block(points, preds, cross);
+  });
+  matrix<Type> L = lower_cholesky(Sigma);
+  L.template triangularView<Eigen::Lower>().solveInPlace(resid);
+  L.template triangularView<Eigen::Lower>().solveInPlace(cross);
+
+  vector<Type> pw(pred_vars.size());
+  for(int m = 0; m < pw.size(); m++) {
+    pw(m) = boundary(pred_coords(m), pred_vars(m)) + cross.col(m).dot(resid);
+  }
+  return pw;
+}
+
+template<class Type>
+void nngp<Type>::predict(pred_graph<Type>& pwg, vector<Type>& pw) {
+  // Points sharing a parent set share the factorisation of the parent block
+  for(int k = 0; k < pwg.groups.size(); k++) {
+    int n_members = pwg.groups.offsets(k + 1) - pwg.groups.offsets(k);
+    vector<vector<Type> > pred_coords(n_members);
+    vector<int> pred_vars(n_members);
+    for(int m = 0; m < n_members; m++) {
+      int idx = pwg.groups.members(pwg.groups.offsets(k) + m);
+      pred_coords(m) = pwg.coord.row(idx);
+      pred_vars(m) = pwg.var(idx);
+    }
+
+    vector<Type> group_pw = predict_shared(
+      pwg.parents(pwg.groups.first(k)),
+      pred_coords,
+      pred_vars
+    );
+    for(int m = 0; m < n_members; m++) {
+      pw(pwg.groups.members(pwg.groups.offsets(k) + m)) = group_pw(m);
+    }
+  }
+}
+
+// Predict the field gradient (dxdx, dydy) at a location with both
+// components sharing the same parents
+template<class Type>
+vector<Type> nngp<Type>::predict_gradient(
+    const vector<Type>& coords,
+    const matrix<int>& parents) {
+  vector<vector<Type> > pred_coords(2);
+  pred_coords(0) = coords;
+  pred_coords(1) = coords;
+  vector<int> pred_vars(2);
+  pred_vars << 1, 2; // 0 = gg, 1 = dxdx, 2 = dydy
+
+  return predict_shared(parents, pred_coords, pred_vars);
+}
+
 template<class Type>
 matrix<int> nngp<Type>::find_nearest_four(vector<Type> coord) {
-  // Get nearest x coordinates
-  Eigen::Matrix<Type, Dynamic, 1> xcoord_d = abs(g.get_x_coordinates() - coord(0));
-  Eigen::VectorXi xind = Eigen::VectorXi::LinSpaced(
-    g.get_x_coordinates().size(),
-    0,
-    g.get_x_coordinates().size() - 1
-  );
-  std::partial_sort(
-    xind.data(),
-    xind.data() + 4,
-    xind.data() + xind.size(),
-    refSorter<Type>(xcoord_d)
-  );
-
-  // Get nearest y coordinates
-  Eigen::Matrix<Type, Dynamic, 1> ycoord_d = abs(g.get_y_coordinates() - coord(1));
-  Eigen::VectorXi yind = Eigen::VectorXi::LinSpaced(
-    g.get_y_coordinates().size(),
-    0,
-    g.get_y_coordinates().size() - 1
-  );
-  std::partial_sort(
-    yind.data(),
-    yind.data() + 4,
-    yind.data() + yind.size(),
-    refSorter<Type>(ycoord_d)
-  );
+  // Lattice coordinates are sorted, so use a binary search in each direction
+  vector<int> xind = nearest_two(g.get_x_coordinates(), coord(0));
+  vector<int> yind = nearest_two(g.get_y_coordinates(), coord(1));
 
   matrix<int> nn(4, 2);
   nn(0, 0) = xind(0);
@@ -3,6 +3,7 @@ struct pred_graph {
   vector<int> var;
   matrix<Type> coord;
   vector<matrix<int> > parents;
+  parent_groups groups;
 
   pred_graph(SEXP r_list) :
       var(asVector<int>(VECTOR_ELT(r_list, 0))),
@@ -12,5 +13,6 @@ struct pred_graph {
     for(int i = 0; i < LENGTH(r_parents); i++) {
       parents(i) = asMatrix<int>(VECTOR_ELT(r_parents, i));
     }
+    groups = parent_groups(parents);
   };
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+// Sources of standard normal draws for the simulate() methods.
+//
+// r_rng uses R's generator, as the SIMULATE blocks always have. counter_rng is
+// counter based: draw n of stream s is a hash of (seed, s, n), so each
+// replicate of a simulation can have its own stream and the draws don't
+// depend on which thread makes them or in what order.
+//
+// A splittable generator can hand out independent child streams with
+// split(id), which lets work be shared between threads. R's generator is a
+// single stream, so r_rng isn't splittable and is only used serially.
+template<class Type>
+struct r_rng {
+  static const bool splittable = false;
+  Type normal() { return rnorm(Type(0.0), Type(1.0)); }
+  r_rng split(uint64_t id) { return *this; }
+};
+
+class counter_rng {
+  private:
+    uint64_t key;
+    uint64_t counter;
+    bool has_spare;
+    double spare;
+
+    // SplitMix64 finaliser
+    static uint64_t mix(uint64_t z) {
+      z += 0x9e3779b97f4a7c15ULL;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    }
+  public:
+    static const bool splittable = true;
+
+    counter_rng(uint64_t seed, uint64_t stream) :
+      key(mix(mix(seed) ^ stream)),
+      counter(0),
+      has_spare(false),
+      spare(0.0) {};
+
+    // Child stream, independent of this one and of other ids
+    counter_rng split(uint64_t id) const { return counter_rng(key, id); }
+
+    // Uniform on (0, 1)
+    double uniform() {
+      uint64_t bits = mix(key ^ mix(counter++));
+      return (static_cast<double>(bits >> 11) + 0.5) / 9007199254740992.0;
+    }
+
+    // Box-Muller, both draws of a pair are used
+    double normal() {
+      if( has_spare ) {
+        has_spare = false;
+        return spare;
+      } else {}
+      double radius = sqrt(-2.0 * log(uniform()));
+      double angle = 2.0 * M_PI * uniform();
+      spare = radius * sin(angle);
+      has_spare = true;
+      return radius * cos(angle);
+    }
+};
@@ -0,0 +1,127 @@
+// Uniform bucket grid for nearest neighbour queries on scattered 2d points.
+//
+// Points are binned into square cells holding about two points each, stored
+// as one flat array of point indices with per-cell offsets. A query searches
+// rings of cells outward from the cell containing the query point and stops
+// once no unvisited cell can hold a closer point.
+//
+// Only uses doubles and the standard library, for the Rcpp graph building
+// routines that find field parents in dag_tools.cpp.
+class bucket_grid {
+  private:
+    std::vector<double> x;
+    std::vector<double> y;
+    double xmin;
+    double ymin;
+    double cell_size;
+    int nx;
+    int ny;
+    std::vector<int> offsets; // Points in cell c are points[offsets[c]:offsets[c + 1]]
+    std::vector<int> points;
+
+    int cell_x(double px) const {
+      int i = static_cast<int>(std::floor((px - xmin) / cell_size));
+      return std::min(std::max(i, 0), nx - 1);
+    }
+    int cell_y(double py) const {
+      int j = static_cast<int>(std::floor((py - ymin) / cell_size));
+      return std::min(std::max(j, 0), ny - 1);
+    }
+  public:
+    bucket_grid(
+      const std::vector<double>& x,
+      const std::vector<double>& y
+    );
+    bucket_grid() : xmin(0.0), ymin(0.0), cell_size(1.0), nx(0), ny(0) {};
+
+    int size() const { return x.size(); }
+
+    // Indices of the k nearest points, closest first
+    std::vector<int> nearest(double px, double py, int k) const;
+};
+
+inline bucket_grid::bucket_grid(
+    const std::vector<double>& x,
+    const std::vector<double>& y) :
+    x(x),
+    y(y) {
+  int n = x.size();
+  if( n == 0 ) {
+    xmin = 0.0;
+    ymin = 0.0;
+    cell_size = 1.0;
+    nx = 0;
+    ny = 0;
+    return;
+  } else {}
+  xmin = *std::min_element(x.begin(), x.end());
+  ymin = *std::min_element(y.begin(), y.end());
+  double width = *std::max_element(x.begin(), x.end()) - xmin;
+  double height = *std::max_element(y.begin(), y.end()) - ymin;
+
+  // About two points per cell, without blowing up for nearly collinear points
+  double area = std::max(width * height, std::pow(std::max(width, height), 2) / n);
+  cell_size = std::sqrt(2.0 * area / n);
+  if( cell_size <= 0.0 ) cell_size = 1.0;
+  nx = static_cast<int>(std::floor(width / cell_size)) + 1;
+  ny = static_cast<int>(std::floor(height / cell_size)) + 1;
+
+  // Counting sort of points into cells
+  std::vector<int> cell(n);
+  offsets.assign(nx * ny + 1, 0);
+  for(int i = 0; i < n; i++) {
+    cell[i] = cell_x(x[i]) + nx * cell_y(y[i]);
+    offsets[cell[i] + 1]++;
+  }
+  for(int c = 0; c < nx * ny; c++) {
+    offsets[c + 1] += offsets[c];
+  }
+  points.resize(n);
+  std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+  for(int i = 0; i < n; i++) {
+    points[fill[cell[i]]++] = i;
+  }
+}
+
+inline std::vector<int> bucket_grid::nearest(double px, double py, int k) const {
+  k = std::min(k, size());
+  std::vector<std::pair<double, int> > best; // (squared distance, index), sorted
+  if( k <= 0 ) return std::vector<int>();
+  best.reserve(k + 1);
+
+  int ci = cell_x(px);
+  int cj = cell_y(py);
+  int max_ring = std::max(nx, ny);
+  for(int r = 0; r <= max_ring; r++) {
+    // Visit every cell with max(|i - ci|, |j - cj|) == r
+    for(int j = cj - r; j <= cj + r; j++) {
+      if( j < 0 || j >= ny ) continue;
+      int step = (j == cj - r || j == cj + r) ? 1 : 2 * r;
+      for(int i = ci - r; i <= ci + r; i += step) {
+        if( i < 0 || i >= nx ) continue;
+        int c = i + nx * j;
+        for(int p = offsets[c]; p < offsets[c + 1]; p++) {
+          int idx = points[p];
+          double d2 = std::pow(x[idx] - px, 2) + std::pow(y[idx] - py, 2);
+          if( static_cast<int>(best.size()) < k || d2 < best.back().first ) {
+            best.insert(
+              std::upper_bound(best.begin(), best.end(), std::make_pair(d2, idx)),
+              std::make_pair(d2, idx)
+            );
+            if( static_cast<int>(best.size()) > k ) best.pop_back();
+          } else {}
+        }
+      }
+    }
+    // Unvisited cells are at least r cells away
+    if( static_cast<int>(best.size()) == k && best.back().first <= std::pow(r * cell_size, 2) ) {
+      break;
+    } else {}
+  }
+
+  std::vector<int> ans(best.size());
+  for(int i = 0; i < static_cast<int>(best.size()); i++) {
+    ans[i] = best[i].second;
+  }
+  return ans;
+}
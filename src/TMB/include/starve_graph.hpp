@@ -1,40 +1,61 @@
 template<class Type>
 class starve_graph {
+    public:
+        // View of vertex indices stored in the graph
+        typedef Eigen::Map<const Eigen::VectorXi> vertex_map;
     private:
         matrix<Type> coordinates;
-        vector<matrix<int> > to_list;
-        vector<matrix<int> > from_list;
+
+        // Vertices of every node stored back to back as [to, from]. Node i
+        // uses entries offsets[i] to offsets[i + 1] - 1, the first n_to[i] of
+        // which are its "to" vertices.
+        std::vector<int> vertices;
+        std::vector<int> offsets {0};
+        std::vector<int> n_to;
+
+        void add_node(const vector<int>& to, const vector<int>& from) {
+            for(int i = 0; i < to.size(); i++) vertices.push_back(to(i));
+            for(int i = 0; i < from.size(); i++) vertices.push_back(from(i));
+            n_to.push_back(to.size());
+            offsets.push_back(offsets.back() + to.size() + from.size());
+        }
     public:
         starve_graph(
             const matrix<Type>& coordinates,
             const vector<vector<int> >& to_list,
             const vector<vector<int> >& from_list
-        ) : coordinates(coordinates), to_list(to_list), from_list(from_list) {};
+        ) : coordinates(coordinates) {
+            for(int i = 0; i < to_list.size(); i++) {
+                add_node(to_list(i), from_list(i));
+            }
+        };
         starve_graph(SEXP r_list) :
                 coordinates(asMatrix<Type>(VECTOR_ELT(r_list, 0))) {
             SEXP r_to = VECTOR_ELT(r_list, 1);
-            to_list.resize(LENGTH(r_to));
-
             SEXP r_from = VECTOR_ELT(r_list, 2);
-            from_list.resize(LENGTH(r_from));
-
             for(int i = 0; i < LENGTH(r_to); i++) {
-                to_list(i) = asVector<int>(VECTOR_ELT(r_to, i));
-                from_list(i) = asVector<int>(VECTOR_ELT(r_from, i));
+                add_node(
+                    asVector<int>(VECTOR_ELT(r_to, i)),
+                    asVector<int>(VECTOR_ELT(r_from, i))
+                );
             }
         };
         starve_graph() = default;
 
-        int size() { return to_list.size(); }
+        int size() { return n_to.size(); }
 
         matrix<Type> get_coordinates() { return coordinates; };
         vector<Type> get_coordinates(int i) { return vector<Type>(coordinates.row(i)); };
+        point2<Type> get_point(int i) { return point2<Type>(coordinates(i, 0), coordinates(i, 1)); };
 
-        vector<int> to(int i) { return to_list(i); }
-        vector<int> from(int i) { return from_list(i); }
-        vector<int> operator() (int i) {
-            vector<int> ans(to(i).rows() + from(i).rows());
-            ans << to(i), from(i);
-            return ans;
+        vertex_map to(int i) { return vertex_map(vertices.data() + offsets[i], n_to[i]); }
+        vertex_map from(int i) {
+            return vertex_map(
+                vertices.data() + offsets[i] + n_to[i],
+                offsets[i + 1] - offsets[i] - n_to[i]
+            );
+        }
+        vertex_map operator() (int i) {
+            return vertex_map(vertices.data() + offsets[i], offsets[i + 1] - offsets[i]);
         }
 };
\ No newline at end of file
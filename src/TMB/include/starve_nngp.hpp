@@ -1,6 +1,8 @@
 template<class Type>
 class starve_nngp {
     private:
+        typedef typename starve_graph<Type>::vertex_map vertex_map;
+
         starve_graph<Type> g;
         array<Type> w;
         covariance<Type> cv;
@@ -8,6 +10,10 @@ class starve_nngp {
         vector<Type> w_node(int idx, int v);
         vector<Type> meanvec(int idx, int v);
         matrix<Type> covmat(int idx, int v);
+
+        // Sparse precision form
+        std::vector<int> flat_indices(const vertex_map& vertices, int v);
+        vecchia<Type> vecchia_form();
     public:
         starve_nngp(
             const starve_graph<Type>& g,
@@ -16,7 +22,8 @@ class starve_nngp {
         ) : g(g), w(w), cv(cv) {};
         starve_nngp() = default;
 
-        Type loglikelihood();
+        Type loglikelihood(objective_function<Type>* obj);
+        Type sparse_loglikelihood();
         Type predict(
             int var,
             const vector<Type> coords,
@@ -28,11 +35,22 @@ class starve_nngp {
             const matrix<int> parents, // Each row is [w_idx, var]
             matrix<Type>& report_Sigma
         );
+        void cross_predict(
+            int var,
+            starve_pred_graph<Type>& pwg,
+            vector<Type>& pw
+        );
+        void cross_predict(
+            int var,
+            starve_pred_graph<Type>& pwg,
+            vector<Type>& pw,
+            matrix<Type>& weights // Row i is d pw(i) / d w for the parents of point i
+        );
 };
 
 template<class Type>
 vector<Type> starve_nngp<Type>::w_node(int idx, int v) {
-    vector<int> vertices = g(idx);
+    vertex_map vertices = g(idx);
     vector<Type> ans(vertices.size());
     for(int i = 0; i < ans.size(); i++) {
         ans(i) = w(vertices(i, 0), v);
@@ -42,17 +60,16 @@ vector<Type> starve_nngp<Type>::w_node(int idx, int v) {
 
 template<class Type>
 matrix<Type> starve_nngp<Type>::covmat(int idx, int v) {
-    vector<int> vertices = g(idx);
-    matrix<Type> ss(vertices.size(), vertices.size());
+    vertex_map vertices = g(idx);
+    point_batch<Type> points(vertices.size());
+    for(int i = 0; i < points.size(); i++) {
+        points.set(i, g.get_point(vertices(i)), v + 1); // 0 = gg, 1 = dxdx, 2 = dydy
+    }
+    matrix<Type> ss;
+    cv.dispatch([&](const auto& kernel) {
+        kernel.block(points, points, ss);
+    });
     for(int i = 0; i < ss.rows(); i++) {
-        for(int j = 0; j < ss.cols(); j++) {
-            ss(i, j) = cv(
-                g.get_coordinates(vertices(i)),
-                g.get_coordinates(vertices(j)),
-                v + 1, // 0 = gg, 1 = dxdx, 2 = dydy
-                v + 1 // 0 = gg, 1 = dxdx, 2 = dydy
-            );
-        }
         ss(i, i) *= 1.001; // Add small number to main diagonal for numerical stability
     }
     return ss;
@@ -60,15 +77,15 @@ matrix<Type> starve_nngp<Type>::covmat(int idx, int v) {
 
 template<class Type>
 vector<Type> starve_nngp<Type>::meanvec(int idx, int v) {
-    vector<int> vertices = g(idx);
-    vector<Type> mm(vertices.size());
+    vector<Type> mm(g(idx).size());
     mm.setZero();
     return mm;
 }
 
 template<class Type>
-Type starve_nngp<Type>::loglikelihood() {
-    Type ll = 0.0;
+Type starve_nngp<Type>::loglikelihood(objective_function<Type>* obj) {
+    // Node terms are split across OpenMP threads
+    parallel_accumulator<Type> ll(obj);
     for(int i = 0; i < g.size(); i++) {
         for(int v = 0; v < w.cols(); v++) {
             vector<Type> this_w = w_node(i, v);
@@ -81,6 +98,48 @@ Type starve_nngp<Type>::loglikelihood() {
     return ll;
 }
 
+template<class Type>
+std::vector<int> starve_nngp<Type>::flat_indices(const vertex_map& vertices, int v) {
+    std::vector<int> ans(vertices.size());
+    for(int i = 0; i < vertices.size(); i++) {
+        ans[i] = vertices(i) + g.get_coordinates().rows() * v;
+    }
+    return ans;
+}
+
+template<class Type>
+vecchia<Type> starve_nngp<Type>::vecchia_form() {
+    vecchia<Type> vf(w.size());
+    for(int v = 0; v < w.cols(); v++) {
+        for(int i = 0; i < g.size(); i++) {
+            vf.add_vertices(flat_indices(g.to(i), v));
+        }
+    }
+    for(int v = 0; v < w.cols(); v++) {
+        for(int i = 0; i < g.size(); i++) {
+            conditional_normal<Type> cmvn(covmat(i, v), g.from(i).size());
+            vf.add_node(
+                flat_indices(g.to(i), v),
+                flat_indices(g.from(i), v),
+                cmvn.regression(),
+                cmvn.conditional_cholesky()
+            );
+        }
+    }
+    return vf;
+}
+
+template<class Type>
+Type starve_nngp<Type>::sparse_loglikelihood() {
+    vector<Type> x(w.size());
+    for(int i = 0; i < x.size(); i++) {
+        x(i) = w(i);
+    }
+    vector<Type> mu(w.size());
+    mu.setZero();
+    return vecchia_form().loglikelihood(x, mu);
+}
+
 template<class Type>
 Type starve_nngp<Type>::predict(
         int var,
@@ -94,24 +153,17 @@ Type starve_nngp<Type>::predict(
     vector<Type> mu(full_w.size());
     mu.setZero();
 
-    matrix<Type> Sigma(full_w.size(), full_w.size());
+    point_batch<Type> points(full_w.size());
+    points.set(0, as_point(coords), var + 1);
+    for(int i = 0; i < parents.size(); i++) {
+        points.set(i + 1, g.get_point(parents(i)), var + 1);
+    }
+
+    matrix<Type> Sigma;
+    cv.dispatch([&](const auto& kernel) {
+        kernel.block(points, points, Sigma);
+    });
     for(int i = 0; i < Sigma.rows(); i++) {
-        for(int j = 0; j < Sigma.cols(); j++) {
-            vector<Type> c1(2);
-            vector<Type> c2(2);
-            if( i == 0 ) {
-                c1 = coords;
-            } else {
-                c1 = g.get_coordinates(parents(i - 1));
-            }
-            if( j == 0 ) {
-                c2 = coords;
-            } else {
-                c2 = g.get_coordinates(parents(j - 1));
-            }
-
-            Sigma(i, j) = cv(c1, c2, var + 1, var + 1);
-        }
         Sigma(i, i) *= 1.001;
     }
 
@@ -135,30 +187,17 @@ Type starve_nngp<Type>::cross_predict(
   vector<Type> mu(full_w.size());
   mu.setZero();
 
-  matrix<Type> Sigma(full_w.size(), full_w.size());
-  for(int i = 0; i < Sigma.rows(); i++) {
-    for(int j = 0; j < Sigma.cols(); j++) {
-        vector<Type> c1(2);
-        vector<Type>c2(2);
-        int v1;
-        int v2;
-        if( i == 0 ) {
-             c1 = coords;
-             v1 = var;
-        } else {
-            c1 = g.get_coordinates(parents(i - 1, 0));
-            v1 = parents(i - 1, 1);
-        }
-        if( j == 0 ) {
-            c2 = coords;
-            v2 = var;
-        } else {
-            c2 = g.get_coordinates(parents(j - 1, 0));
-            v2 = parents(j - 1, 1);
-        }
+  point_batch<Type> points(full_w.size());
+  points.set(0, as_point(coords), var);
+  for(int i = 0; i < parents.rows(); i++) {
+    points.set(i + 1, g.get_point(parents(i, 0)), parents(i, 1));
+  }
 
-        Sigma(i, j) = cv(c1, c2, v1, v2);
-    }
+  matrix<Type> Sigma;
+  cv.dispatch([&](const auto& kernel) {
+    kernel.block(points, points, Sigma);
+  });
+  for(int i = 0; i < Sigma.rows(); i++) {
     Sigma(i, i) *= 1.001;
   }
   report_Sigma = Sigma;
@@ -167,4 +206,67 @@ Type starve_nngp<Type>::cross_predict(
   full_w(0) = cmvn.conditional_mean(full_w, mu)(0);
 
   return full_w(0);
+}
+
+template<class Type>
+void starve_nngp<Type>::cross_predict(
+      int var,
+      starve_pred_graph<Type>& pwg,
+      vector<Type>& pw
+  ) {
+  matrix<Type> no_weights(0, 0);
+  cross_predict(var, pwg, pw, no_weights);
+}
+
+template<class Type>
+void starve_nngp<Type>::cross_predict(
+      int var,
+      starve_pred_graph<Type>& pwg,
+      vector<Type>& pw,
+      matrix<Type>& weights
+  ) {
+  // Points sharing a parent set share the factorisation of the parent block,
+  //   pw = (L^-1 Sigma_cp)^T L^-1 w_c, Sigma_cc = L L^T
+  for(int k = 0; k < pwg.groups.size(); k++) {
+    const matrix<int>& parents = pwg.parents(pwg.groups.first(k)); // Each row is [w_idx, var]
+    int nc = parents.rows();
+
+    point_batch<Type> points(nc);
+    Eigen::Matrix<Type, Dynamic, 1> parent_w(nc);
+    for(int i = 0; i < nc; i++) {
+      points.set(i, g.get_point(parents(i, 0)), parents(i, 1));
+      parent_w(i) = w(parents(i, 0), parents(i, 1) - 1);
+    }
+    int n_members = pwg.groups.offsets(k + 1) - pwg.groups.offsets(k);
+    point_batch<Type> members(n_members);
+    for(int m = 0; m < n_members; m++) {
+      int idx = pwg.groups.members(pwg.groups.offsets(k) + m);
+      members.set(m, point2<Type>(pwg.coord(idx, 0), pwg.coord(idx, 1)), var);
+    }
+
+    // Parent block and the cross covariances of every member, column m
+    matrix<Type> Sigma;
+    matrix<Type> cross;
+    cv.dispatch([&](const auto& kernel) {
+      kernel.block(points, points, Sigma);
+      kernel.block(points, members, cross);
+    });
+    for(int i = 0; i < nc; i++) {
+      Sigma(i, i) *= 1.001;
+    }
+    matrix<Type> L = lower_cholesky(Sigma);
+    L.template triangularView<Eigen::Lower>().solveInPlace(parent_w);
+    L.template triangularView<Eigen::Lower>().solveInPlace(cross);
+
+    for(int m = 0; m < n_members; m++) {
+      pw(pwg.groups.members(pwg.groups.offsets(k) + m)) = cross.col(m).dot(parent_w);
+    }
+    if( weights.rows() > 0 ) {
+      // Kriging weights Sigma_cc^-1 Sigma_cp
+      L.template triangularView<Eigen::Lower>().transpose().solveInPlace(cross);
+      for(int m = 0; m < n_members; m++) {
+        weights.row(pwg.groups.members(pwg.groups.offsets(k) + m)).head(nc) = cross.col(m).transpose();
+      }
+    } else {}
+  }
 }
\ No newline at end of file
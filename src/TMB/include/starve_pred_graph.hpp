@@ -2,6 +2,7 @@ template<class Type>
 struct starve_pred_graph {
     matrix<Type> coord;
     vector<matrix<int> > parents;
+    parent_groups groups;
 
     starve_pred_graph(SEXP r_list) :
             coord(asMatrix<Type>(VECTOR_ELT(r_list, 0))) {
@@ -10,5 +11,6 @@ struct starve_pred_graph {
         for(int i = 0; i < LENGTH(r_parents); i++) {
             parents(i) = asMatrix<int>(VECTOR_ELT(r_parents, i));
         }
+        groups = parent_groups(parents);
     };
 };
\ No newline at end of file
@@ -20,11 +20,58 @@ struct vvint {
   }
 };
 
+// Indices of the two values of an increasing vector closest to c, closest first
 template<class Type>
-struct refSorter {
-  refSorter(const Eigen::Matrix<Type, Dynamic, 1> &d) : d_(d) {}
-  bool operator () (const int a, const int b) {
-    return d_(a) < d_(b);
+vector<int> nearest_two(const vector<Type>& sorted, Type c) {
+  int n = sorted.size();
+  int upper = std::lower_bound(sorted.data(), sorted.data() + n, c) - sorted.data();
+  int lower = upper - 1;
+  vector<int> ans(2);
+  for(int i = 0; i < ans.size(); i++) {
+    if( upper >= n || (lower >= 0 && c - sorted(lower) <= sorted(upper) - c) ) {
+      ans(i) = lower--;
+    } else {
+      ans(i) = upper++;
+    }
   }
-  const Eigen::Matrix<Type, Dynamic, 1> d_;
-};
+  return ans;
+}
+
+// Groups of identical parent matrices, e.g. prediction points sharing a parent set.
+// Group k is members(offsets(k)) to members(offsets(k + 1) - 1).
+struct parent_groups {
+  vector<int> members;
+  vector<int> offsets;
+
+  parent_groups(const vector<matrix<int> >& parents) {
+    std::map<std::vector<int>, int> seen;
+    std::vector<int> group(parents.size());
+    std::vector<int> count;
+    for(int i = 0; i < parents.size(); i++) {
+      std::vector<int> key(parents(i).data(), parents(i).data() + parents(i).size());
+      key.push_back(parents(i).rows());
+      auto it = seen.find(key);
+      if( it == seen.end() ) {
+        it = seen.insert(std::make_pair(key, static_cast<int>(count.size()))).first;
+        count.push_back(0);
+      } else {}
+      group[i] = it->second;
+      count[group[i]]++;
+    }
+
+    offsets.resize(count.size() + 1);
+    offsets(0) = 0;
+    for(int k = 0; k < static_cast<int>(count.size()); k++) {
+      offsets(k + 1) = offsets(k) + count[k];
+    }
+    members.resize(parents.size());
+    std::vector<int> fill(offsets.data(), offsets.data() + count.size());
+    for(int i = 0; i < parents.size(); i++) {
+      members(fill[group[i]]++) = i;
+    }
+  };
+  parent_groups() = default;
+
+  int size() { return std::max(static_cast<int>(offsets.size()) - 1, 0); }
+  int first(int k) { return members(offsets(k)); }
+};
\ No newline at end of file
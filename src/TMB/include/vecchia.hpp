@@ -0,0 +1,151 @@
+// Sparse precision (Vecchia) form of a nearest neighbour Gaussian process.
+//
+// Each node of the graph says w_P = mu_P + A (w_C - mu_C) + e, e ~ N(0, D),
+// where P are the node's "to" vertices and C its "from" vertices. Stacking the
+// nodes in graph order gives (I - B)(w - mu) = e, so
+//   Q = (I - B)^T D^-1 (I - B) and log|Q| = -log|D|.
+//
+// Vertices are added in graph order with add_vertices before any node is
+// added with add_node, so parents have a position even if they come later.
+// B is then only strictly lower triangular when every parent comes before its
+// children. The likelihood doesn't need that, since B is nilpotent for any
+// nearest neighbour DAG so |I - B| = 1, but simulate solves with the lower
+// triangle of I - B and errors for a graph out of topological order.
+
+// Which field likelihood engine is requested in the data list? 0 = dense
+// conditional densities, 1 = sparse precision. It's optional so existing
+// data lists get the dense engine.
+template<class Type>
+int requested_field_engine(objective_function<Type>* obj) {
+  SEXP engine = getListElement(obj->data, "field_engine");
+  return Rf_isNull(engine) ? 0 : asInteger(engine);
+}
+
+template<class Type>
+class vecchia {
+  private:
+    typedef Eigen::Triplet<Type> triplet;
+    typedef Eigen::Matrix<Type, Dynamic, 1> column;
+
+    std::vector<int> order; // order[pos] = flat index of the vertex in position pos
+    std::vector<int> position; // position[flat index] = position of the vertex
+    std::vector<triplet> whitened; // D^-1/2 (I - B)
+    std::vector<triplet> unit_lower; // I - B
+    std::vector<triplet> root_D; // D^1/2, block diagonal
+    Type log_det_D;
+    bool lower_triangular; // Do all parents come before their children?
+  public:
+    vecchia(int n) : position(n, -1), log_det_D(0.0), lower_triangular(true) {};
+    vecchia() : log_det_D(0.0), lower_triangular(true) {};
+
+    int size() { return order.size(); }
+
+    void add_vertices(const std::vector<int>& to);
+    void add_node(
+      const std::vector<int>& to,
+      const std::vector<int>& from,
+      const matrix<Type>& A, // Sigma_PC * Sigma_CC^-1
+      const matrix<Type>& L // Cholesky factor of D
+    );
+
+    Eigen::SparseMatrix<Type> precision();
+    Type loglikelihood(const vector<Type>& x, const vector<Type>& mu);
+    vector<Type> simulate(const vector<Type>& mu);
+    template<class RNG> vector<Type> simulate(const vector<Type>& mu, RNG& rng);
+};
+
+template<class Type>
+void vecchia<Type>::add_vertices(const std::vector<int>& to) {
+  for(int i = 0; i < static_cast<int>(to.size()); i++) {
+    position[to[i]] = order.size();
+    order.push_back(to[i]);
+  }
+}
+
+template<class Type>
+void vecchia<Type>::add_node(
+    const std::vector<int>& to,
+    const std::vector<int>& from,
+    const matrix<Type>& A,
+    const matrix<Type>& L) {
+  int np = to.size();
+  int nc = from.size();
+
+  // Row block of I - B for this node, columns ordered as [to, from]
+  matrix<Type> M(np, np + nc);
+  M.setZero();
+  M.leftCols(np).setIdentity();
+  M.rightCols(nc) = -A;
+  matrix<Type> W = M;
+  L.template triangularView<Eigen::Lower>().solveInPlace(W);
+
+  std::vector<int> cols(np + nc);
+  for(int j = 0; j < np; j++) cols[j] = position[to[j]];
+  for(int j = 0; j < nc; j++) cols[np + j] = position[from[j]];
+
+  for(int i = 0; i < np; i++) {
+    int row = position[to[i]];
+    for(int j = 0; j < np + nc; j++) {
+      if( j < np && j > i ) continue; // Structural zeros
+      if( cols[j] > row ) lower_triangular = false;
+      whitened.push_back(triplet(row, cols[j], W(i, j)));
+      if( j >= np || j == i ) {
+        unit_lower.push_back(triplet(row, cols[j], M(i, j)));
+      } else {}
+    }
+    for(int j = 0; j <= i; j++) {
+      root_D.push_back(triplet(row, cols[j], L(i, j)));
+    }
+    log_det_D += 2.0 * log(L(i, i));
+  }
+}
+
+template<class Type>
+Eigen::SparseMatrix<Type> vecchia<Type>::precision() {
+  Eigen::SparseMatrix<Type> R(size(), size());
+  R.setFromTriplets(whitened.begin(), whitened.end());
+  Eigen::SparseMatrix<Type> Q = R.transpose() * R;
+  return Q;
+}
+
+template<class Type>
+Type vecchia<Type>::loglikelihood(const vector<Type>& x, const vector<Type>& mu) {
+  vector<Type> r(size());
+  for(int pos = 0; pos < size(); pos++) {
+    r(pos) = x(order[pos]) - mu(order[pos]);
+  }
+  // log|Q| is known from D, so GMRF doesn't need to factor Q
+  return -1.0 * GMRF(precision(), false)(r) - 0.5 * log_det_D;
+}
+
+template<class Type>
+vector<Type> vecchia<Type>::simulate(const vector<Type>& mu) {
+  r_rng<Type> rng;
+  return simulate(mu, rng);
+}
+
+template<class Type>
+template<class RNG>
+vector<Type> vecchia<Type>::simulate(const vector<Type>& mu, RNG& rng) {
+  if( !lower_triangular ) {
+    error("Sparse field simulation needs a graph in topological order.");
+  } else {}
+  column z(size());
+  for(int pos = 0; pos < size(); pos++) {
+    z(pos) = rng.normal();
+  }
+  Eigen::SparseMatrix<Type> sqrt_D(size(), size());
+  sqrt_D.setFromTriplets(root_D.begin(), root_D.end());
+  Eigen::SparseMatrix<Type> T(size(), size());
+  T.setFromTriplets(unit_lower.begin(), unit_lower.end());
+
+  // (I - B)(x - mu) = D^1/2 z
+  column e = sqrt_D * z;
+  column y = T.template triangularView<Eigen::Lower>().solve(e);
+
+  vector<Type> x = mu;
+  for(int pos = 0; pos < size(); pos++) {
+    x(order[pos]) = mu(order[pos]) + y(pos);
+  }
+  return x;
+}
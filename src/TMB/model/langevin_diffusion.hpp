@@ -3,6 +3,11 @@
 
 template<class Type>
 Type langevin_diffusion(objective_function<Type>* obj) {
+  // Optional per phase cost counters
+  bool instrumented = instrument_requested(obj);
+  instrumentation& profile = instrumentation::get();
+  profile.reset(instrumented);
+
   // Boundary effects
   PARAMETER_VECTOR(boundary_x);
   PARAMETER_VECTOR(boundary_y);
@@ -16,10 +21,11 @@ Type langevin_diffusion(objective_function<Type>* obj) {
   PARAMETER_VECTOR(working_cv_pars);
   vector<Type> cv_pars = exp(working_cv_pars);
   ADREPORT(cv_pars);
-  covariance<Type> cv {cv_pars, cv_code};
+  covariance<Type> cv {cv_pars, cv_code, smoothness_fixed(obj)};
 
   // Nearest neighbour graph and random effects
   DATA_STRUCT(g, nngp_graph);
+  int field_engine = requested_field_engine(obj); // 0 = dense conditional densities, 1 = sparse precision
   PARAMETER_ARRAY(w);
 
   REPORT(w);
@@ -27,34 +33,35 @@ Type langevin_diffusion(objective_function<Type>* obj) {
   // Spatial field for utilization / gradient
   nngp<Type> field(g, w, boundary, cv);
 
-  Type field_ll = field.loglikelihood();
+  profile.begin<Type>(instrumentation::field);
+  Type field_ll = 0.0;
+  if( field_engine == 1 ) {
+    // One term, so only one OpenMP thread records it
+    PARALLEL_REGION field_ll = field.sparse_loglikelihood();
+  } else {
+    field_ll = field.loglikelihood(obj);
+  }
+  profile.end<Type>();
   SIMULATE{
-    w = field.simulate();
+    if( field_engine == 1 ) {
+      w = field.sparse_simulate();
+    } else {
+      w = field.simulate();
+    }
     REPORT(w);
   }
 
   // Predictions for spatial field
   DATA_STRUCT(pwg, pred_graph);
   vector<Type> pw(pwg.var.size());
-
-  for(int i = 0; i < pw.size(); i++) {
-    pw(i) = field.predict(
-      pwg.var(i),
-      pwg.coord.row(i),
-      pwg.parents(i)
-    );
-  }
+  profile.begin<Type>(instrumentation::predictions);
+  field.predict(pwg, pw);
+  profile.end<Type>();
   REPORT(pw);
   ADREPORT(pw);
 
   SIMULATE{
-    for(int i = 0; i < pw.size(); i++) {
-      pw(i) = field.predict(
-        pwg.var(i),
-        pwg.coord.row(i),
-        pwg.parents(i)
-      );
-    }
+    field.predict(pwg, pw);
     REPORT(pw);
   }
 
@@ -67,7 +74,9 @@ Type langevin_diffusion(objective_function<Type>* obj) {
   ADREPORT(gamma);
 
   loc_track<Type> track {true_coord, field_neighbours, true_time, gamma};
-  Type track_ll = track.loglikelihood(field);
+  profile.begin<Type>(instrumentation::track);
+  Type track_ll = track.loglikelihood(field, obj);
+  profile.end<Type>();
 
   matrix<Type> track_gradient = track.track_gradient;
   ADREPORT(track_gradient);
@@ -91,7 +100,9 @@ Type langevin_diffusion(objective_function<Type>* obj) {
     ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2), pow(ping_cov_pars(2), 2);
   ADREPORT(ping_cov);
 
-  Type pings_ll = pings.loglikelihood(ping_cov, track);
+  profile.begin<Type>(instrumentation::pings);
+  Type pings_ll = pings.loglikelihood(ping_cov, track, obj);
+  profile.end<Type>();
   SIMULATE{
     matrix<Type> sim_pings = pings.simulate(ping_cov, track);
     REPORT(sim_pings);
@@ -100,6 +111,10 @@ Type langevin_diffusion(objective_function<Type>* obj) {
   REPORT(field_ll);
   REPORT(track_ll);
   REPORT(pings_ll);
+  if( instrumented ) {
+    matrix<Type> instrumentation_table = profile.table().cast<Type>();
+    REPORT(instrumentation_table);
+  } else {}
 
   return -1.0 * (field_ll + track_ll + pings_ll);
 }
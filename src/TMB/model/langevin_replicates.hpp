@@ -0,0 +1,115 @@
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR obj
+
+// Independent replicates of the langevin_diffusion simulation (field, field
+// predictions, track, and pings) from the same data and parameters plus
+// n_replicates and seed. Meant to be evaluated with obj$report() on a
+// MakeADFun(..., type = "Fun") object so no AD tape is recorded. Replicates
+// are split across OpenMP threads and replicate r draws from
+// counter_rng(seed, r), so the results don't depend on the number of threads.
+template<class Type>
+Type langevin_replicates(objective_function<Type>* obj) {
+  DATA_INTEGER(n_replicates);
+  DATA_INTEGER(seed);
+
+  // Boundary effects
+  PARAMETER_VECTOR(boundary_x);
+  PARAMETER_VECTOR(boundary_y);
+  PARAMETER(working_boundary_sharpness);
+  Type boundary_sharpness = exp(working_boundary_sharpness);
+  boundary_mean<Type> boundary {boundary_x, boundary_y, boundary_sharpness};
+
+  // Covariance function
+  DATA_INTEGER(cv_code);
+  PARAMETER_VECTOR(working_cv_pars);
+  vector<Type> cv_pars = exp(working_cv_pars);
+  covariance<Type> cv {cv_pars, cv_code};
+
+  // Nearest neighbour graph and random effects
+  DATA_STRUCT(g, nngp_graph);
+  int field_engine = requested_field_engine(obj); // 0 = dense conditional densities, 1 = sparse precision
+  PARAMETER_ARRAY(w);
+  DATA_STRUCT(pwg, pred_graph);
+
+  // True Movement Path
+  PARAMETER_MATRIX(true_coord);
+  DATA_STRUCT(field_neighbours, vmint);
+  DATA_VECTOR(true_time);
+  PARAMETER(log_gamma);
+  Type gamma = exp(log_gamma);
+
+  // Observed Locations
+  DATA_STRUCT(pings, loc_observations);
+  PARAMETER_VECTOR(working_ping_cov_pars);
+  vector<Type> ping_cov_pars = exp(working_ping_cov_pars);
+  ping_cov_pars(1) = 2 * invlogit(working_ping_cov_pars(1)) - 1.0;
+  matrix<Type> ping_cov(2, 2);
+  ping_cov << pow(ping_cov_pars(0), 2), ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2),
+    ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2), pow(ping_cov_pars(2), 2);
+
+  // The last index of each output is the replicate
+  matrix<Type> w_replicates(w.size(), n_replicates);
+  matrix<Type> pw_replicates(pwg.var.size(), n_replicates);
+  vector<int> track_dim(3);
+  track_dim << true_coord.rows(), true_coord.cols(), n_replicates;
+  array<Type> true_coord_replicates(track_dim);
+  array<Type> track_gradient_replicates(track_dim);
+  vector<int> ping_dim(3);
+  ping_dim << pings.size(), 2, n_replicates;
+  array<Type> sim_pings_replicates(ping_dim);
+
+  // Each replicate's field copies g, so find its levels and covariance
+  // patterns once here
+  g.n_levels();
+  g.n_patterns();
+
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) if(isDouble<Type>::value)
+#endif
+  for(int r = 0; r < n_replicates; r++) {
+    counter_rng rng(seed, r);
+
+    nngp<Type> field(g, w, boundary, cv);
+    array<Type> sim_w;
+    if( field_engine == 1 ) {
+      sim_w = field.sparse_simulate(rng);
+    } else {
+      sim_w = field.simulate(rng);
+    }
+    for(int i = 0; i < sim_w.size(); i++) {
+      w_replicates(i, r) = sim_w(i);
+    }
+
+    vector<Type> pw(pwg.var.size());
+    field.predict(pwg, pw);
+    pw_replicates.col(r) = pw.matrix();
+
+    loc_track<Type> track {true_coord, field_neighbours, true_time, gamma};
+    matrix<Type> sim_coord = track.simulate(field, rng);
+
+    loc_observations<Type> replicate_pings = pings;
+    matrix<Type> sim_pings = replicate_pings.simulate(ping_cov, track, rng);
+
+    for(int t = 0; t < sim_coord.rows(); t++) {
+      for(int v = 0; v < sim_coord.cols(); v++) {
+        true_coord_replicates(t, v, r) = sim_coord(t, v);
+        track_gradient_replicates(t, v, r) = track.track_gradient(t, v);
+      }
+    }
+    for(int i = 0; i < sim_pings.rows(); i++) {
+      for(int v = 0; v < 2; v++) {
+        sim_pings_replicates(i, v, r) = sim_pings(i, v);
+      }
+    }
+  }
+  REPORT(w_replicates);
+  REPORT(pw_replicates);
+  REPORT(true_coord_replicates);
+  REPORT(track_gradient_replicates);
+  REPORT(sim_pings_replicates);
+
+  return Type(0.0);
+}
+
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR this
@@ -3,7 +3,13 @@
 
 template<class Type>
 Type nngp_model(objective_function<Type>* obj) {
+  // Optional per phase cost counters
+  bool instrumented = instrument_requested(obj);
+  instrumentation& profile = instrumentation::get();
+  profile.reset(instrumented);
+
   DATA_INTEGER(cv_code);
+  int field_engine = requested_field_engine(obj); // 0 = dense conditional densities, 1 = sparse precision
   DATA_STRUCT(g, nngp_graph);
   DATA_ARRAY(y);
   DATA_STRUCT(pwg, pred_graph);
@@ -24,23 +30,37 @@ Type nngp_model(objective_function<Type>* obj) {
   vector<Type> cv_pars = exp(working_cv_pars);
   ADREPORT(cv_pars);
 
-  covariance<Type> cv {cv_pars, cv_code};
+  covariance<Type> cv {cv_pars, cv_code, smoothness_fixed(obj)};
   nngp<Type> field(g, w, boundary, cv);
 
-  Type field_ll = field.loglikelihood();
+  profile.begin<Type>(instrumentation::field);
+  Type field_ll = 0.0;
+  if( field_engine == 1 ) {
+    // One term, so only one OpenMP thread records it
+    PARALLEL_REGION field_ll = field.sparse_loglikelihood();
+  } else {
+    field_ll = field.loglikelihood(obj);
+  }
+  profile.end<Type>();
   SIMULATE{
-    w = field.simulate();
+    if( field_engine == 1 ) {
+      w = field.sparse_simulate();
+    } else {
+      w = field.simulate();
+    }
     REPORT(w);
   }
 
-  Type obs_ll = 0.0;
+  // Observation terms are split across OpenMP threads
+  parallel_accumulator<Type> obs_terms(obj);
   for(int i = 0; i < y.dim(0); i++) {
     for(int j = 0; j < y.dim(1); j++) {
       for(int k = 0; k < y.dim(2); k++) {
-        obs_ll += dnorm(y(i, j, k), w(i, j, k), Type(1.0), true);
+        obs_terms += dnorm(y(i, j, k), w(i, j, k), Type(1.0), true);
       }
     }
   }
+  Type obs_ll = obs_terms;
   SIMULATE{
     for(int i = 0; i < y.dim(0); i++) {
       for(int j = 0; j < y.dim(1); j++) {
@@ -52,19 +72,19 @@ Type nngp_model(objective_function<Type>* obj) {
     REPORT(y);
   }
 
-  for(int i = 0; i < pw.size(); i++) {
-    pw(i) = field.predict(
-      pwg.var(i),
-      pwg.coord.row(i),
-      pwg.parents(i)
-    );
-  }
+  profile.begin<Type>(instrumentation::predictions);
+  field.predict(pwg, pw);
+  profile.end<Type>();
   ADREPORT(pw);
 
   Type ll = field_ll + obs_ll;
   REPORT(ll);
   REPORT(field_ll);
   REPORT(obs_ll);
+  if( instrumented ) {
+    matrix<Type> instrumentation_table = profile.table().cast<Type>();
+    REPORT(instrumentation_table);
+  } else {}
 
   return -1.0 * ll;
 }
@@ -3,6 +3,11 @@
 
 template<class Type>
 Type random_walk(objective_function<Type>* obj) {
+  // Optional per phase cost counters
+  bool instrumented = instrument_requested(obj);
+  instrumentation& profile = instrumentation::get();
+  profile.reset(instrumented);
+
   PARAMETER_MATRIX(true_loc);
   DATA_VECTOR(true_time);
   PARAMETER(log_gamma);
@@ -24,13 +29,21 @@ Type random_walk(objective_function<Type>* obj) {
 
   ADREPORT(Sigma);
 
-  Type proc_ll = true_track.loglikelihood();
-  Type obs_ll = pings.loglikelihood(Sigma, true_track);
+  profile.begin<Type>(instrumentation::track);
+  Type proc_ll = true_track.loglikelihood(obj);
+  profile.end<Type>();
+  profile.begin<Type>(instrumentation::pings);
+  Type obs_ll = pings.loglikelihood(Sigma, true_track, obj);
+  profile.end<Type>();
   Type ll = proc_ll + obs_ll;
 
   REPORT(ll);
   REPORT(proc_ll);
   REPORT(obs_ll);
+  if( instrumented ) {
+    matrix<Type> instrumentation_table = profile.table().cast<Type>();
+    REPORT(instrumentation_table);
+  } else {}
 
   SIMULATE{
     true_loc = true_track.simulate();
@@ -0,0 +1,43 @@
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR obj
+
+// random_walk with the true locations integrated out exactly by a Kalman
+// filter instead of the Laplace approximation
+template<class Type>
+Type random_walk_kf(objective_function<Type>* obj) {
+  DATA_VECTOR(true_time);
+  PARAMETER(log_gamma);
+
+  Type gamma = exp(log_gamma);
+  ADREPORT(gamma);
+
+  kalman_track<Type> true_track {true_time, gamma};
+
+
+  DATA_STRUCT(pings, loc_observations);
+
+  PARAMETER_VECTOR(working_obs_cov_pars);
+  vector<Type> obs_cov_pars = exp(working_obs_cov_pars);
+  obs_cov_pars(1) = 2 * invlogit(working_obs_cov_pars(1)) - 1.0;
+  matrix<Type> Sigma(2, 2);
+  Sigma << pow(obs_cov_pars(0), 2), obs_cov_pars(1) * obs_cov_pars(0) * obs_cov_pars(2),
+    obs_cov_pars(1) * obs_cov_pars(0) * obs_cov_pars(2), pow(obs_cov_pars(2), 2);
+
+  ADREPORT(Sigma);
+
+  // One term, so only one OpenMP thread records it
+  Type ll = 0.0;
+  PARALLEL_REGION ll = true_track.loglikelihood(Sigma, pings);
+
+  // Smoothed true locations and their standard deviations given the parameters
+  matrix<Type> true_loc = true_track.smoothed_mean;
+  matrix<Type> true_loc_sd = true_track.smoothed_sd;
+  REPORT(ll);
+  REPORT(true_loc);
+  REPORT(true_loc_sd);
+
+  return -1.0 * ll;
+}
+
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR this
@@ -1,117 +1,142 @@
 #undef TMB_OBJECTIVE_PTR
 #define TMB_OBJECTIVE_PTR obj
 
-template<class Type>
-matrix<Type> conjugate(matrix<Type> Sigma, matrix<Type> K, int q) {
-  matrix<Type> diagK(2, 2);
-  diagK << K(q, 0), 0.0, 0.0, K(q, 1);
-  return diagK * Sigma * diagK;
-}
-
 template<class Type>
 Type starve_npmlangevin(objective_function<Type>* obj) {
+  // Optional per phase cost counters
+  bool instrumented = instrument_requested(obj);
+  instrumentation& profile = instrumentation::get();
+  profile.reset(instrumented);
+
   // Covariance function
   DATA_INTEGER(cv_code);
   PARAMETER_VECTOR(working_cv_pars);
   vector<Type> cv_pars = exp(working_cv_pars);
   ADREPORT(cv_pars);
-  covariance<Type> cv {cv_pars, cv_code};
+  covariance<Type> cv {cv_pars, cv_code, smoothness_fixed(obj)};
 
   // Nearest neighbour graph and random effects
   DATA_STRUCT(g, starve_graph);
+  int field_engine = requested_field_engine(obj); // 0 = dense conditional densities, 1 = sparse precision
   PARAMETER_ARRAY(w);
   REPORT(w);
 
   // Spatial field for utilization / gradient
   starve_nngp<Type> field(g, w, cv);
-  Type field_ll = field.loglikelihood();
+  profile.begin<Type>(instrumentation::field);
+  Type field_ll = 0.0;
+  if( field_engine == 1 ) {
+    // One term, so only one OpenMP thread records it
+    PARALLEL_REGION field_ll = field.sparse_loglikelihood();
+  } else {
+    field_ll = field.loglikelihood(obj);
+  }
+  profile.end<Type>();
 
 
   // Predictions for utilization distribution
   DATA_STRUCT(pwg, starve_pred_graph);
   vector<Type> pw(pwg.coord.rows());
-  vector<matrix<Type> > Sigmas(pw.size());
-
-  for(int i = 0; i < pw.rows(); i++) {
-      matrix<Type> this_Sigma = Sigmas(i);
-      pw(i) = field.cross_predict(
-        0,
-        pwg.coord.row(i),
-        pwg.parents(i),
-        this_Sigma
-      );
-      Sigmas(i) = this_Sigma;
-  }
-  REPORT(Sigmas);
+  profile.begin<Type>(instrumentation::predictions);
+  field.cross_predict(0, pwg, pw);
+  profile.end<Type>();
   REPORT(pw);
   ADREPORT(pw);
 
 
-  // Movement Process
+  // Movement Process, with the tracks of several animals stacked. Track k has
+  //   locations track_start(k) to track_start(k + 1) - 1 and pings
+  //   ping_start(k) to ping_start(k + 1) - 1. random_walk and
+  //   location_differences have one row less per track, so the step from
+  //   location t of track k is row t - k.
   DATA_MATRIX(coordinates);
   DATA_STRUCT(field_neighbours, vvint);
-
-  matrix<Type> coord_gradients(coordinates.rows(), coordinates.cols());
-
-  for(int t = 0; t < coord_gradients.rows(); t++) {
-    for(int v = 0; v < coord_gradients.cols(); v++) {
-      coord_gradients(t, v) = field.predict(
-        v,
-        vector<Type>(coordinates.row(t)),
-        field_neighbours.x(t)
-      );
-    }
-  }
-  REPORT(coord_gradients);
+  DATA_VECTOR(time);
+  DATA_IVECTOR(track_start);
+  DATA_IVECTOR(ping_start);
+  int n_tracks = track_start.size() - 1;
 
   PARAMETER_MATRIX(random_walk);
-  Type rw_ll = 0.0;
-  for(int t = 0; t < random_walk.rows(); t++) {
-    for(int v = 0; v < random_walk.cols(); v++) {
-      rw_ll += dnorm(random_walk(t, v), Type(0.0), Type(1.0), true);
-    }
-  }
-
-  DATA_VECTOR(time);
-  PARAMETER(log_gamma);
-  Type gamma = exp(log_gamma);
+  PARAMETER_VECTOR(log_gamma); // One per track
+  vector<Type> gamma = exp(log_gamma);
   ADREPORT(gamma);
 
-  matrix<Type> location_difference_means(random_walk.rows(), random_walk.cols());
-  for(int t = 0; t < location_difference_means.rows(); t++) {
-    for(int v = 0; v < location_difference_means.cols(); v++) {
-      location_difference_means(t, v) = 0.5 * (time(t + 1) - time(t)) * coord_gradients(t, v) + gamma * sqrt(time(t + 1) - time(t)) * random_walk(t, v);
-    }
-  }
-
-  REPORT(location_difference_means);
-
   // Observation Noise + random walk movement noise
   DATA_MATRIX(location_differences);
   DATA_IVECTOR(location_quality_class);
 
   DATA_MATRIX(K);
-  PARAMETER_VECTOR(working_ping_cov_pars);
-  vector<Type> ping_cov_pars = exp(working_ping_cov_pars);
-  ping_cov_pars(1) = 2 * invlogit(working_ping_cov_pars(1)) - 1.0;
+  PARAMETER_MATRIX(working_ping_cov_pars); // One column per track
+  vector<int> ping_cov_dim(3);
+  ping_cov_dim << 2, 2, n_tracks;
+  array<Type> ping_cov(ping_cov_dim);
 
-  matrix<Type> ping_cov(2, 2);
-  ping_cov << pow(ping_cov_pars(0), 2), ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2),
-    ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2), pow(ping_cov_pars(2), 2);
-  ADREPORT(ping_cov);
+  matrix<Type> coord_gradients(coordinates.rows(), coordinates.cols());
+  matrix<Type> location_difference_means(random_walk.rows(), random_walk.cols());
+
+  // Tracks only share the field, so each track is one term split across
+  //   OpenMP threads
+  parallel_accumulator<Type> movement_ll(obj);
+  for(int k = 0; k < n_tracks; k++) {
+    profile.begin<Type>(instrumentation::track);
+    for(int t = track_start(k); t < track_start(k + 1); t++) {
+      for(int v = 0; v < coord_gradients.cols(); v++) {
+        coord_gradients(t, v) = field.predict(
+          v,
+          vector<Type>(coordinates.row(t)),
+          field_neighbours.x(t)
+        );
+      }
+    }
 
-  Type ping_ll = 0.0;
-  for(int t = 0; t < location_differences.rows(); t++) {
-    matrix<Type> Sigma = conjugate(ping_cov, K, location_quality_class(t))
-      + conjugate(ping_cov, K, location_quality_class(t + 1));
-    ping_ll -= MVNORM<Type>(Sigma)(
-      vector<Type>(
-        location_differences.row(t) - location_difference_means.row(t)
-      )
-    );
+    Type rw_ll = 0.0;
+    for(int t = track_start(k); t < track_start(k + 1) - 1; t++) {
+      for(int v = 0; v < random_walk.cols(); v++) {
+        rw_ll += dnorm(random_walk(t - k, v), Type(0.0), Type(1.0), true);
+        location_difference_means(t - k, v) = 0.5 * (time(t + 1) - time(t)) * coord_gradients(t, v) + gamma(k) * sqrt(time(t + 1) - time(t)) * random_walk(t - k, v);
+      }
+    }
+    profile.end<Type>();
+
+    vector<Type> working_pars = working_ping_cov_pars.col(k);
+    vector<Type> ping_cov_pars = exp(working_pars);
+    ping_cov_pars(1) = 2 * invlogit(working_pars(1)) - 1.0;
+
+    matrix<Type> track_ping_cov(2, 2);
+    track_ping_cov << pow(ping_cov_pars(0), 2), ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2),
+      ping_cov_pars(1) * ping_cov_pars(0) * ping_cov_pars(2), pow(ping_cov_pars(2), 2);
+    for(int i = 0; i < 2; i++) {
+      for(int j = 0; j < 2; j++) {
+        ping_cov(i, j, k) = track_ping_cov(i, j);
+      }
+    }
+
+    // Location differences have the summed ping errors of both end points
+    profile.begin<Type>(instrumentation::pings);
+    ping_covariances<Type> diff_cov(track_ping_cov, K);
+    Type ping_ll = 0.0;
+    for(int p = ping_start(k); p < ping_start(k + 1) - 1; p++) {
+      int step = track_start(k) - k + (p - ping_start(k));
+      ping_ll += diff_cov(location_quality_class(p), location_quality_class(p + 1)).loglikelihood(
+        location_differences(p - k, 0) - location_difference_means(step, 0),
+        location_differences(p - k, 1) - location_difference_means(step, 1)
+      );
+    }
+    profile.end<Type>();
+
+    movement_ll += rw_ll + ping_ll;
   }
+  REPORT(coord_gradients);
+  REPORT(location_difference_means);
+  ADREPORT(ping_cov);
+  REPORT(field_ll);
+
+  if( instrumented ) {
+    matrix<Type> instrumentation_table = profile.table().cast<Type>();
+    REPORT(instrumentation_table);
+  } else {}
 
-  return -1.0 * (field_ll + rw_ll + ping_ll);
+  return -1.0 * (field_ll + movement_ll);
 }
 
 #undef TMB_OBJECTIVE_PTR
@@ -0,0 +1,40 @@
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR obj
+
+// Utilization distribution predictions for one tile of prediction locations
+// from a fitted starve_npmlangevin model. The parameters are the fitted
+// working_cv_pars and w, and nothing is estimated, so this is meant to be
+// evaluated in double with obj$report() on a MakeADFun(..., type = "Fun")
+// object, keeping the predictions off the AD tape.
+template<class Type>
+Type starve_predict(objective_function<Type>* obj) {
+  // Covariance function
+  DATA_INTEGER(cv_code);
+  PARAMETER_VECTOR(working_cv_pars);
+  vector<Type> cv_pars = exp(working_cv_pars);
+  covariance<Type> cv {cv_pars, cv_code};
+
+  // Nearest neighbour graph and fitted random effects
+  DATA_STRUCT(g, starve_graph);
+  PARAMETER_ARRAY(w);
+  starve_nngp<Type> field(g, w, cv);
+
+  // Predictions and their kriging weights, used for delta method standard errors
+  DATA_STRUCT(pwg, starve_pred_graph);
+  DATA_INTEGER(return_weights);
+  int max_parents = 0;
+  for(int i = 0; i < pwg.parents.size(); i++) {
+    max_parents = std::max(max_parents, int(pwg.parents(i).rows()));
+  }
+  vector<Type> pw(pwg.coord.rows());
+  matrix<Type> pw_weights(return_weights == 1 ? pwg.coord.rows() : 0, max_parents);
+  pw_weights.setZero();
+  field.cross_predict(0, pwg, pw, pw_weights);
+  REPORT(pw);
+  REPORT(pw_weights);
+
+  return Type(0.0);
+}
+
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR this
@@ -1,16 +1,22 @@
 #define TMB_LIB_INIT R_init_npmlangevin
 #include <TMB.hpp>
+#include <chrono>
 using namespace density;
 
 #include "include/utilities.hpp"
+#include "include/instrumentation.hpp"
+#include "include/random_streams.hpp"
+#include "include/bivariate_normal.hpp"
 #include "include/boundary_mean.hpp"
 #include "include/covariance.hpp"
 #include "include/conditional_normal.hpp"
+#include "include/vecchia.hpp"
 #include "include/graph.hpp"
 #include "include/pred_graph.hpp"
 #include "include/nngp.hpp"
 #include "include/loc_track.hpp"
 #include "include/loc_observations.hpp"
+#include "include/kalman_track.hpp"
 
 #include "include/starve_graph.hpp"
 #include "include/starve_pred_graph.hpp"
@@ -19,10 +25,15 @@ using namespace density;
 #include "model/covariance_1d_deriv.hpp"
 #include "model/nngp_model.hpp"
 #include "model/random_walk.hpp"
+#include "model/random_walk_kf.hpp"
 #include "model/langevin_diffusion.hpp"
+#include "model/langevin_replicates.hpp"
 #include "model/starve_npmlangevin.hpp"
+#include "model/starve_predict.hpp"
 
 #include "other/covariance_exploration.hpp"
+#include "other/nngp_prediction_exploration.hpp"
+#include "other/starve_prediction_exploration.hpp"
 
 
 template<class Type>
@@ -30,16 +41,26 @@ Type objective_function<Type>::operator() () {
   DATA_STRING(model);
   if( model == "covariance_exploration" ) {
     return covariance_exploration(this);
+  } else if( model == "nngp_prediction_exploration" ) {
+    return nngp_prediction_exploration(this);
+  } else if( model == "starve_prediction_exploration" ) {
+    return starve_prediction_exploration(this);
   } else if( model == "covariance_1d_deriv" ) {
     return covariance_1d_deriv(this);
   } else if( model == "nngp_model" ) {
     return nngp_model(this);
   } else if( model == "random_walk" ) {
     return random_walk(this);
+  } else if( model == "random_walk_kf" ) {
+    return random_walk_kf(this);
   } else if( model == "langevin_diffusion" ) {
     return langevin_diffusion(this);
+  } else if( model == "langevin_replicates" ) {
+    return langevin_replicates(this);
   } else if( model == "starve_npmlangevin" ) {
     return starve_npmlangevin(this);
+  } else if( model == "starve_predict" ) {
+    return starve_predict(this);
   } else {
     error("Unknown model.");
   }
@@ -9,7 +9,7 @@ Type covariance_exploration(objective_function<Type>* obj) {
   PARAMETER(dummy);
 
   vector<Type> cv_pars = exp(working_cv_pars);
-  covariance<Type> f {cv_pars, cv_code};
+  covariance<Type> f {cv_pars, cv_code, smoothness_fixed(obj)};
 
   vector<Type> x1(2);
   x1 << 0.0, 0.0;
@@ -46,6 +46,71 @@ Type covariance_exploration(objective_function<Type>* obj) {
   REPORT(dy_dx);
   REPORT(dy_dy);
 
+  // Closed form derivatives next to the nested AD versions, ordered as
+  // [g_g, g_dx, g_dy, dx_g, dx_dx, dx_dy, dy_g, dy_dx, dy_dy]
+  matrix<Type> analytic_cov(x.rows(), 9);
+  matrix<Type> ad_cov(x.rows(), 9);
+  for(int i = 0; i < x.rows(); i++) {
+    vector<Type> x2 = x.row(i);
+    for(int v1 = 0; v1 < 3; v1++) {
+      for(int v2 = 0; v2 < 3; v2++) {
+        analytic_cov(i, 3 * v1 + v2) = f(x1, x2, v1, v2);
+        ad_cov(i, 3 * v1 + v2) = f.ad_derivative(x1, x2, v1, v2);
+      }
+    }
+  }
+  REPORT(analytic_cov);
+  REPORT(ad_cov);
+
+  // The same covariances through covariance::dispatch, which uses the closed
+  // form Matern for half integer nu and the tabulated one for nu > 3 when it
+  // can. Both are ADREPORTed so MakeADFun(..., ADreport = TRUE) gives their
+  // derivatives with respect to working_cv_pars.
+  matrix<Type> kernel_cov(x.rows(), 9);
+  f.dispatch([&](const auto& kernel) {
+    for(int i = 0; i < x.rows(); i++) {
+      vector<Type> x2 = x.row(i);
+      for(int v1 = 0; v1 < 3; v1++) {
+        for(int v2 = 0; v2 < 3; v2++) {
+          kernel_cov(i, 3 * v1 + v2) = kernel(as_point(x1), as_point(x2), v1, v2);
+        }
+      }
+    }
+  });
+  REPORT(kernel_cov);
+  ADREPORT(kernel_cov);
+  ADREPORT(analytic_cov);
+
+  // covariance_kernel::block between every variable of the first few points
+  // of x, as a symmetric block(a, a) and as block(a, b) with a copy of the
+  // points, next to the scalar kernel evaluated entry by entry
+  int n_block = std::min(int(x.rows()), 20);
+  point_batch<Type> points(3 * n_block);
+  for(int i = 0; i < n_block; i++) {
+    for(int v = 0; v < 3; v++) {
+      points.set(3 * i + v, point2<Type>(x(i, 0), x(i, 1)), v);
+    }
+  }
+  point_batch<Type> points_copy = points;
+  matrix<Type> block_cov;
+  matrix<Type> cross_block_cov;
+  matrix<Type> scalar_block_cov(points.size(), points.size());
+  f.dispatch([&](const auto& kernel) {
+    kernel.block(points, points, block_cov);
+    kernel.block(points, points_copy, cross_block_cov);
+    for(int i = 0; i < points.size(); i++) {
+      for(int j = 0; j < points.size(); j++) {
+        scalar_block_cov(i, j) = kernel(points.point(i), points.point(j), points.v(i), points.v(j));
+      }
+    }
+  });
+  REPORT(block_cov);
+  REPORT(cross_block_cov);
+  REPORT(scalar_block_cov);
+  ADREPORT(block_cov);
+  ADREPORT(cross_block_cov);
+  ADREPORT(scalar_block_cov);
+
   return pow(dummy, 2);
 }
 
@@ -0,0 +1,56 @@
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR obj
+
+// Lattice field predictions at the points of pwg, from the batched
+// nngp::predict(pwg, pw) next to nngp::predict one point at a time, and the
+// gradient (dxdx, dydy) at the same points and parents from predict_gradient
+// next to two predict calls. All are ADREPORTed so MakeADFun(...,
+// ADreport = TRUE) gives their derivatives.
+template<class Type>
+Type nngp_prediction_exploration(objective_function<Type>* obj) {
+  DATA_INTEGER(cv_code);
+  DATA_STRUCT(g, nngp_graph);
+  DATA_STRUCT(pwg, pred_graph);
+
+  PARAMETER_VECTOR(boundary_x);
+  PARAMETER_VECTOR(boundary_y);
+  PARAMETER(working_boundary_sharpness);
+  boundary_mean<Type> boundary {boundary_x, boundary_y, exp(working_boundary_sharpness)};
+
+  PARAMETER_VECTOR(working_cv_pars);
+  PARAMETER_ARRAY(w);
+  vector<Type> cv_pars = exp(working_cv_pars);
+  covariance<Type> cv {cv_pars, cv_code, smoothness_fixed(obj)};
+  nngp<Type> field(g, w, boundary, cv);
+
+  vector<Type> batch_pw(pwg.var.size());
+  field.predict(pwg, batch_pw);
+  vector<Type> point_pw(pwg.var.size());
+  for(int i = 0; i < point_pw.size(); i++) {
+    vector<Type> coords = pwg.coord.row(i);
+    point_pw(i) = field.predict(pwg.var(i), coords, pwg.parents(i));
+  }
+  REPORT(batch_pw);
+  REPORT(point_pw);
+  ADREPORT(batch_pw);
+  ADREPORT(point_pw);
+
+  matrix<Type> shared_gradient(pwg.var.size(), 2);
+  matrix<Type> point_gradient(pwg.var.size(), 2);
+  for(int i = 0; i < shared_gradient.rows(); i++) {
+    vector<Type> coords = pwg.coord.row(i);
+    shared_gradient.row(i) = field.predict_gradient(coords, pwg.parents(i));
+    for(int v = 1; v <= 2; v++) {
+      point_gradient(i, v - 1) = field.predict(v, coords, pwg.parents(i));
+    }
+  }
+  REPORT(shared_gradient);
+  REPORT(point_gradient);
+  ADREPORT(shared_gradient);
+  ADREPORT(point_gradient);
+
+  return Type(0.0);
+}
+
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR this
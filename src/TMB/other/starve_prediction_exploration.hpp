@@ -0,0 +1,57 @@
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR obj
+
+// Mesh field predictions of variable pred_var at the points of pwg, from the
+// batched starve_nngp::cross_predict(var, pwg, pw, weights) next to
+// cross_predict one point at a time. The per point kriging weights are
+// Sigma_cc^-1 Sigma_cp from the covariance matrix it reports. The predictions
+// are ADREPORTed so MakeADFun(..., ADreport = TRUE) gives their derivatives.
+template<class Type>
+Type starve_prediction_exploration(objective_function<Type>* obj) {
+  DATA_INTEGER(cv_code);
+  DATA_STRUCT(g, starve_graph);
+  DATA_STRUCT(pwg, starve_pred_graph);
+  DATA_INTEGER(pred_var);
+
+  PARAMETER_VECTOR(working_cv_pars);
+  PARAMETER_ARRAY(w);
+  vector<Type> cv_pars = exp(working_cv_pars);
+  covariance<Type> cv {cv_pars, cv_code};
+  starve_nngp<Type> field(g, w, cv);
+
+  int max_parents = 0;
+  for(int i = 0; i < pwg.parents.size(); i++) {
+    max_parents = std::max(max_parents, int(pwg.parents(i).rows()));
+  }
+  vector<Type> batch_pw(pwg.coord.rows());
+  matrix<Type> batch_weights(pwg.coord.rows(), max_parents);
+  batch_weights.setZero();
+  field.cross_predict(pred_var, pwg, batch_pw, batch_weights);
+
+  vector<Type> point_pw(pwg.coord.rows());
+  matrix<Type> point_weights(pwg.coord.rows(), max_parents);
+  point_weights.setZero();
+  for(int i = 0; i < point_pw.size(); i++) {
+    vector<Type> coords = pwg.coord.row(i);
+    matrix<Type> Sigma;
+    point_pw(i) = field.cross_predict(pred_var, coords, pwg.parents(i), Sigma);
+
+    int nc = pwg.parents(i).rows();
+    matrix<Type> L = lower_cholesky(matrix<Type>(Sigma.bottomRightCorner(nc, nc)));
+    matrix<Type> weights = Sigma.col(0).tail(nc);
+    L.template triangularView<Eigen::Lower>().solveInPlace(weights);
+    L.template triangularView<Eigen::Lower>().transpose().solveInPlace(weights);
+    point_weights.row(i).head(nc) = weights.col(0).transpose();
+  }
+  REPORT(batch_pw);
+  REPORT(point_pw);
+  REPORT(batch_weights);
+  REPORT(point_weights);
+  ADREPORT(batch_pw);
+  ADREPORT(point_pw);
+
+  return Type(0.0);
+}
+
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR this
@@ -1,25 +1,331 @@
 #include <Rcpp.h>
 #include <RcppEigen.h>
+#include <array>
+#include <set>
+#include "TMB/include/spatial_index.hpp"
 // [[Rcpp::depends(RcppEigen)]]
 
+// Order the vertices of an adjacency matrix so that each vertex has as many
+// already ordered neighbours as possible. At each step the unordered vertex
+// with the most ordered neighbours (column sums over ordered rows) is moved
+// into the next position by swapping it with the vertex currently there, and
+// ties go to the lowest current position.
+//
+// Vertices are kept in a set keyed on (-number of ordered neighbours,
+// current position) so only the neighbours of the newly ordered vertex and
+// the swapped vertex need updating.
 // [[Rcpp::export("order_adjacency_matrix")]]
-Eigen::VectorXi order_adjacency_matrix(Eigen::MatrixXi &m) {
-  Eigen::VectorXi order = Eigen::VectorXi::LinSpaced(
-    m.rows(),
-    0,
-    m.rows() - 1
-  );
-  for(int i = 0; i < m.rows(); i++) {
-    Eigen::VectorXi n_parents = m
-      .topRightCorner(i, m.cols() - i)
-      .colwise()
-      .sum();
-    int next_vertex;
-    n_parents.maxCoeff(&next_vertex);
-    next_vertex += i;
-    m.row(i).swap(m.row(next_vertex));
-    m.col(i).swap(m.col(next_vertex));
-    std::iter_swap(order.data() + i, order.data() + next_vertex);
+Eigen::VectorXi order_adjacency_matrix(const Eigen::Map<Eigen::SparseMatrix<double> > m) {
+  int n = m.rows();
+  Eigen::SparseMatrix<double> rows = m.transpose(); // Column i is row i of m
+
+  Eigen::VectorXi order = Eigen::VectorXi::LinSpaced(n, 0, n - 1);
+  std::vector<int> position(n);
+  std::vector<double> n_parents(n, 0.0);
+  std::vector<bool> ordered(n, false);
+  std::set<std::pair<double, int> > queue;
+  for(int v = 0; v < n; v++) {
+    position[v] = v;
+    queue.insert(std::make_pair(0.0, v));
+  }
+
+  for(int i = 0; i < n; i++) {
+    int next_vertex = order(queue.begin()->second);
+    queue.erase(queue.begin());
+    ordered[next_vertex] = true;
+
+    // Swap positions with the vertex currently in position i
+    int swapped = order(i);
+    if( swapped != next_vertex ) {
+      int old_position = position[next_vertex];
+      queue.erase(std::make_pair(-n_parents[swapped], i));
+      queue.insert(std::make_pair(-n_parents[swapped], old_position));
+      order(old_position) = swapped;
+      position[swapped] = old_position;
+      order(i) = next_vertex;
+      position[next_vertex] = i;
+    } else {}
+
+    for(Eigen::SparseMatrix<double>::InnerIterator it(rows, next_vertex); it; ++it) {
+      int child = it.row();
+      if( ordered[child] ) continue;
+      queue.erase(std::make_pair(-n_parents[child], position[child]));
+      n_parents[child] += it.value();
+      queue.insert(std::make_pair(-n_parents[child], position[child]));
+    }
   }
   return order;
+}
+
+// Build the starve edge list for an adjacency matrix and vertex ordering from
+// order_adjacency_matrix. The first n_init vertices form the first node and
+// every later vertex is its own node with its already ordered neighbours as
+// parents. Indices in the edge list are 1-based positions in the ordering.
+// [[Rcpp::export("adjacency_edge_list")]]
+Rcpp::List adjacency_edge_list(
+    const Eigen::Map<Eigen::SparseMatrix<double> > m,
+    const Eigen::VectorXi& order,
+    int n_init) {
+  int n = order.size();
+  std::vector<int> position(n);
+  for(int i = 0; i < n; i++) {
+    position[order(i)] = i;
+  }
+
+  Rcpp::List edge_list(n - n_init + 1);
+  edge_list[0] = Rcpp::List::create(
+    Rcpp::Named("to") = Rcpp::seq(1, n_init),
+    Rcpp::Named("from") = Rcpp::IntegerVector(0)
+  );
+  for(int i = n_init; i < n; i++) {
+    std::vector<int> from;
+    for(Eigen::Map<Eigen::SparseMatrix<double> >::InnerIterator it(m, order(i)); it; ++it) {
+      if( it.value() != 0 && position[it.row()] < i ) {
+        from.push_back(position[it.row()] + 1);
+      } else {}
+    }
+    std::sort(from.begin(), from.end());
+    edge_list[i - n_init + 1] = Rcpp::List::create(
+      Rcpp::Named("to") = Rcpp::IntegerVector::create(i + 1),
+      Rcpp::Named("from") = Rcpp::wrap(from)
+    );
+  }
+  return edge_list;
+}
+
+// Vertex rows [i, j, k] are 1-based indices into the x & y coordinates and
+// the variable (1 = gg, 2 = dxdx, 3 = dydy), matching make_nn_graph
+Rcpp::CharacterVector lattice_colnames() {
+  return Rcpp::CharacterVector::create("i", "j", "k");
+}
+
+// Parents of a lattice vertex that fall inside the xl x yl grid
+std::vector<std::array<int, 3> > lattice_parents(int i, int j, int k, int xl, int yl) {
+  std::vector<std::array<int, 3> > candidates;
+  if( k == 1 ) {
+    // gg
+    candidates = {
+      {i - 2, j, 2}, {i - 1, j, 2}, {i + 1, j, 2}, {i + 2, j, 2},
+      {i, j - 2, 3}, {i, j - 1, 3}, {i, j + 1, 3}, {i, j + 2, 3}
+    };
+  } else if( k == 2 ) {
+    // dx_dx
+    candidates = {
+      {i - 2, j, 2}, {i, j - 1, 2}, {i, j - 2, 2},
+      {i - 1, j - 1, 3}, {i - 1, j + 1, 3}
+    };
+  } else {
+    // dy_dy
+    candidates = {
+      {i, j - 2, 3}, {i - 1, j, 3}, {i - 2, j, 3},
+      {i - 1, j - 1, 2}, {i - 1, j + 1, 2}
+    };
+  }
+  std::vector<std::array<int, 3> > parents;
+  for(const std::array<int, 3>& p : candidates) {
+    if( 1 <= p[0] && p[0] <= xl && 1 <= p[1] && p[1] <= yl ) {
+      parents.push_back(p);
+    } else {}
+  }
+  return parents;
+}
+
+// Build the nearest neighbour graph for an xl x yl lattice. The derivative
+// vertices come first, ordered by (i, j, k), followed by the gg vertices
+// ordered by (j, i). Each node has one "to" vertex, and graph_ordered says
+// whether every parent comes before its child.
+// [[Rcpp::export("lattice_graph")]]
+Rcpp::List lattice_graph(int xl, int yl) {
+  std::vector<std::array<int, 3> > idx;
+  idx.reserve(3 * xl * yl);
+  for(int i = 1; i <= xl; i++) {
+    for(int j = 1; j <= yl; j++) {
+      for(int k = 2; k <= 3; k++) {
+        idx.push_back({i, j, k});
+      }
+    }
+  }
+  for(int j = 1; j <= yl; j++) {
+    for(int i = 1; i <= xl; i++) {
+      idx.push_back({i, j, 1});
+    }
+  }
+
+  std::vector<int> idx_order(3 * xl * yl);
+  for(int row = 0; row < static_cast<int>(idx.size()); row++) {
+    const std::array<int, 3>& v = idx[row];
+    idx_order[(v[0] - 1) + xl * ((v[1] - 1) + yl * (v[2] - 1))] = row;
+  }
+
+  bool graph_ordered = true;
+  Rcpp::List graph(idx.size());
+  for(int row = 0; row < static_cast<int>(idx.size()); row++) {
+    const std::array<int, 3>& v = idx[row];
+    Rcpp::IntegerMatrix to(1, 3);
+    for(int c = 0; c < 3; c++) to(0, c) = v[c];
+    Rcpp::colnames(to) = lattice_colnames();
+
+    std::vector<std::array<int, 3> > parents = lattice_parents(v[0], v[1], v[2], xl, yl);
+    Rcpp::NumericMatrix from(parents.size(), 3);
+    for(int p = 0; p < static_cast<int>(parents.size()); p++) {
+      for(int c = 0; c < 3; c++) from(p, c) = parents[p][c];
+      int parent_order = idx_order[
+        (parents[p][0] - 1) + xl * ((parents[p][1] - 1) + yl * (parents[p][2] - 1))
+      ];
+      if( parent_order >= row ) graph_ordered = false;
+    }
+    Rcpp::colnames(from) = lattice_colnames();
+
+    graph[row] = Rcpp::List::create(
+      Rcpp::Named("to") = to,
+      Rcpp::Named("from") = from
+    );
+  }
+
+  return Rcpp::List::create(
+    Rcpp::Named("graph") = graph,
+    Rcpp::Named("graph_ordered") = graph_ordered
+  );
+}
+
+// Find the k lattice vertices nearest to each prediction location, closest
+// first. x & y are the increasing lattice coordinates, coord the n x 2
+// prediction locations and v their variables.
+// [[Rcpp::export("lattice_pred_parents")]]
+Rcpp::List lattice_pred_parents(
+    const Eigen::VectorXd& x,
+    const Eigen::VectorXd& y,
+    const Eigen::MatrixXd& coord,
+    const Eigen::VectorXi& v,
+    int k) {
+  int xl = x.size();
+  int yl = y.size();
+  Rcpp::List parents(coord.rows());
+  for(int p = 0; p < coord.rows(); p++) {
+    int ci = std::lower_bound(x.data(), x.data() + xl, coord(p, 0)) - x.data();
+    int cj = std::lower_bound(y.data(), y.data() + yl, coord(p, 1)) - y.data();
+
+    // The k nearest vertices are within k cells of the closest grid line
+    std::vector<std::pair<double, std::array<int, 2> > > candidates;
+    for(int i = std::max(ci - k, 0); i < std::min(ci + k, xl); i++) {
+      for(int j = std::max(cj - k, 0); j < std::min(cj + k, yl); j++) {
+        double dx = x(i) - coord(p, 0);
+        double dy = y(j) - coord(p, 1);
+        candidates.push_back(std::make_pair(dx * dx + dy * dy, std::array<int, 2>{i, j}));
+      }
+    }
+    int n = std::min(k, static_cast<int>(candidates.size()));
+    std::partial_sort(
+      candidates.begin(),
+      candidates.begin() + n,
+      candidates.end()
+    );
+
+    Rcpp::NumericMatrix ans(n, 3);
+    for(int r = 0; r < n; r++) {
+      ans(r, 0) = candidates[r].second[0] + 1;
+      ans(r, 1) = candidates[r].second[1] + 1;
+      ans(r, 2) = v(p);
+    }
+    Rcpp::colnames(ans) = lattice_colnames();
+    parents[p] = ans;
+  }
+  return parents;
+}
+
+// Distance at which a covariance function is steepest, i.e. its inflection
+// point, used to space the parents of the derivative processes. cv_pars are
+// on the natural scale. The exponential covariance is convex so this is 0.
+// For the Matern with smoothness nu the second derivative is proportional to
+// K_{nu - 1}(x) - x K_{nu - 2}(x) with x = r / range, which is positive near
+// 0 and changes sign once when nu > 1/2, so its root is found by bisection.
+// [[Rcpp::export("inflection_point")]]
+double inflection_point(int cv_code, const Eigen::VectorXd& cv_pars) {
+  if( cv_code == 1 || cv_code == 3 ) {
+    // Gaussian and Matern32
+    return cv_pars(1);
+  } else if( cv_code == 2 ) {
+    double nu = cv_pars(2);
+    auto second_derivative = [nu](double x) {
+      // Exponentially scaled Bessel functions have the same sign pattern
+      return R::bessel_k(x, std::fabs(nu - 1.0), 2.0) - x * R::bessel_k(x, std::fabs(nu - 2.0), 2.0);
+    };
+    double lower = 1e-8;
+    if( second_derivative(lower) <= 0.0 ) return 0.0;
+    double upper = 1.0;
+    for(int i = 0; i < 60 && second_derivative(upper) > 0.0; i++) {
+      lower = upper;
+      upper *= 2.0;
+    }
+    while( upper - lower > 1e-10 * upper ) {
+      double mid = 0.5 * (lower + upper);
+      if( second_derivative(mid) > 0.0 ) {
+        lower = mid;
+      } else {
+        upper = mid;
+      }
+    }
+    return 0.5 * (lower + upper) * cv_pars(1);
+  } else {}
+  return 0.0;
+}
+
+// Bucket grid over the rows of a coordinate matrix
+bucket_grid coordinate_grid(const Eigen::MatrixXd& coord) {
+  std::vector<double> x(coord.col(0).data(), coord.col(0).data() + coord.rows());
+  std::vector<double> y(coord.col(1).data(), coord.col(1).data() + coord.rows());
+  return bucket_grid(x, y);
+}
+
+// The k nearest field vertices of each prediction location, 1-based and
+// closest first, in one pass over a spatial index of the field.
+// [[Rcpp::export("starve_pred_parents")]]
+Rcpp::List starve_pred_parents(
+    const Eigen::MatrixXd& pred,
+    const Eigen::MatrixXd& field,
+    int k) {
+  bucket_grid grid = coordinate_grid(field);
+  Rcpp::List parents(pred.rows());
+  for(int p = 0; p < pred.rows(); p++) {
+    std::vector<int> nn = grid.nearest(pred(p, 0), pred(p, 1), k);
+    Rcpp::IntegerVector ans(nn.size());
+    for(int i = 0; i < static_cast<int>(nn.size()); i++) {
+      ans[i] = nn[i] + 1;
+    }
+    parents[p] = ans;
+  }
+  return parents;
+}
+
+// Parents of the utilization distribution at each prediction location: the k
+// nearest field vertices to the points shift to the left, right, bottom, and
+// top. Each element is a 4k x 2 matrix with columns i (1-based vertex) and v,
+// where v = 2 (dx) for the left and right parents and v = 3 (dy) for the
+// bottom and top parents.
+// [[Rcpp::export("starve_gg_pred_parents")]]
+Rcpp::List starve_gg_pred_parents(
+    const Eigen::MatrixXd& pred,
+    const Eigen::MatrixXd& field,
+    double shift,
+    int k) {
+  bucket_grid grid = coordinate_grid(field);
+  const double shifts[4][2] = {{-shift, 0.0}, {shift, 0.0}, {0.0, -shift}, {0.0, shift}};
+  Rcpp::List parents(pred.rows());
+  for(int p = 0; p < pred.rows(); p++) {
+    std::vector<std::array<int, 2> > rows;
+    for(int d = 0; d < 4; d++) {
+      std::vector<int> nn = grid.nearest(pred(p, 0) + shifts[d][0], pred(p, 1) + shifts[d][1], k);
+      for(int i = 0; i < static_cast<int>(nn.size()); i++) {
+        rows.push_back(std::array<int, 2>{nn[i] + 1, d < 2 ? 2 : 3});
+      }
+    }
+    Rcpp::IntegerMatrix ans(rows.size(), 2);
+    for(int r = 0; r < static_cast<int>(rows.size()); r++) {
+      ans(r, 0) = rows[r][0];
+      ans(r, 1) = rows[r][1];
+    }
+    Rcpp::colnames(ans) = Rcpp::CharacterVector::create("i", "v");
+    parents[p] = ans;
+  }
+  return parents;
 }
\ No newline at end of file